@@ -0,0 +1,177 @@
+#include "Animation.hpp"
+
+#include <cassert>
+#include <cmath>
+
+template< uint32_t N >
+void Animation::Channel< N >::add(uint32_t track_index, float const *keys, uint32_t key_count) {
+	assert(key_count > 0);
+	track.emplace_back(track_index);
+	first.emplace_back(uint32_t(key[0].size()));
+	count.emplace_back(key_count);
+	for (uint32_t c = 0; c < N; ++c) {
+		for (uint32_t k = 0; k < key_count; ++k) {
+			key[c].emplace_back(keys[k * N + c]);
+		}
+	}
+}
+
+template< uint32_t N >
+void Animation::Channel< N >::clear() {
+	track.clear();
+	first.clear();
+	count.clear();
+	for (uint32_t c = 0; c < N; ++c) {
+		key[c].clear();
+		a[c].clear();
+		b[c].clear();
+		value[c].clear();
+	}
+	t.clear();
+}
+
+template< uint32_t N >
+void Animation::Channel< N >::locate(Animation const &animation) {
+	uint32_t entries = uint32_t(track.size());
+	t.resize(entries);
+	for (uint32_t c = 0; c < N; ++c) {
+		a[c].resize(entries);
+		b[c].resize(entries);
+		value[c].resize(entries);
+	}
+
+	for (uint32_t e = 0; e < entries; ++e) {
+		float frame = animation.track_time[track[e]] * animation.track_fps[track[e]];
+		float whole = std::floor(frame);
+		uint32_t k = uint32_t(whole) % count[e];
+		uint32_t ia = first[e] + k;
+		uint32_t ib = first[e] + (k + 1 == count[e] ? 0 : k + 1);
+		for (uint32_t c = 0; c < N; ++c) {
+			a[c][e] = key[c][ia];
+			b[c][e] = key[c][ib];
+		}
+		t[e] = frame - whole;
+	}
+}
+
+void Animation::add_track(Scene &scene, Scene::Transform *transform, float fps,
+	std::vector< glm::vec3 > const &position_keys,
+	std::vector< glm::quat > const &rotation_keys,
+	std::vector< glm::vec3 > const &scale_keys,
+	float time) {
+	assert(transform);
+	assert(fps > 0.0f);
+	assert(time >= 0.0f);
+
+	uint32_t track_index = uint32_t(track_transform.size());
+	track_transform.emplace_back(scene.handle(transform));
+	track_fps.emplace_back(fps);
+	track_time.emplace_back(time);
+
+	if (!position_keys.empty()) {
+		std::vector< float > flat;
+		for (auto const &p : position_keys) {
+			flat.emplace_back(p.x); flat.emplace_back(p.y); flat.emplace_back(p.z);
+		}
+		positions.add(track_index, flat.data(), uint32_t(position_keys.size()));
+	}
+	if (!rotation_keys.empty()) {
+		std::vector< float > flat;
+		for (auto const &r : rotation_keys) {
+			flat.emplace_back(r.x); flat.emplace_back(r.y); flat.emplace_back(r.z); flat.emplace_back(r.w);
+		}
+		rotations.add(track_index, flat.data(), uint32_t(rotation_keys.size()));
+	}
+	if (!scale_keys.empty()) {
+		std::vector< float > flat;
+		for (auto const &s : scale_keys) {
+			flat.emplace_back(s.x); flat.emplace_back(s.y); flat.emplace_back(s.z);
+		}
+		scales.add(track_index, flat.data(), uint32_t(scale_keys.size()));
+	}
+}
+
+//linear blend of vector-valued keys (one independent loop per component):
+template< uint32_t N >
+static void blend_linear(Animation::Channel< N > &channel) {
+	uint32_t entries = uint32_t(channel.track.size());
+	float const *t = channel.t.data();
+	for (uint32_t c = 0; c < N; ++c) {
+		float const *a = channel.a[c].data();
+		float const *b = channel.b[c].data();
+		float *out = channel.value[c].data();
+		for (uint32_t e = 0; e < entries; ++e) {
+			out[e] = a[e] + (b[e] - a[e]) * t[e];
+		}
+	}
+}
+
+//normalized linear blend of quaternion keys along the shorter arc:
+static void blend_rotations(Animation::Channel< 4 > &channel) {
+	uint32_t entries = uint32_t(channel.track.size());
+	float const *ax = channel.a[0].data(), *ay = channel.a[1].data(), *az = channel.a[2].data(), *aw = channel.a[3].data();
+	float const *bx = channel.b[0].data(), *by = channel.b[1].data(), *bz = channel.b[2].data(), *bw = channel.b[3].data();
+	float const *t = channel.t.data();
+	float *ox = channel.value[0].data(), *oy = channel.value[1].data(), *oz = channel.value[2].data(), *ow = channel.value[3].data();
+	for (uint32_t e = 0; e < entries; ++e) {
+		float d = ax[e] * bx[e] + ay[e] * by[e] + az[e] * bz[e] + aw[e] * bw[e];
+		float wa = 1.0f - t[e];
+		float wb = (d < 0.0f ? -t[e] : t[e]);
+		float x = wa * ax[e] + wb * bx[e];
+		float y = wa * ay[e] + wb * by[e];
+		float z = wa * az[e] + wb * bz[e];
+		float w = wa * aw[e] + wb * bw[e];
+		float inv_len = 1.0f / std::sqrt(x*x + y*y + z*z + w*w);
+		ox[e] = x * inv_len;
+		oy[e] = y * inv_len;
+		oz[e] = z * inv_len;
+		ow[e] = w * inv_len;
+	}
+}
+
+void Animation::update(Scene &scene, float elapsed) {
+	for (auto &time : track_time) {
+		time += elapsed;
+	}
+
+	positions.locate(*this);
+	rotations.locate(*this);
+	scales.locate(*this);
+
+	blend_linear(positions);
+	blend_rotations(rotations);
+	blend_linear(scales);
+
+	//write results into transforms:
+	std::vector< Scene::Transform * > transforms(track_transform.size());
+	for (uint32_t i = 0; i < track_transform.size(); ++i) {
+		transforms[i] = scene.get(track_transform[i]);
+	}
+	for (uint32_t e = 0; e < positions.track.size(); ++e) {
+		Scene::Transform *transform = transforms[positions.track[e]];
+		if (!transform) continue;
+		transform->position = glm::vec3(positions.value[0][e], positions.value[1][e], positions.value[2][e]);
+		transform->dirty = true;
+	}
+	for (uint32_t e = 0; e < rotations.track.size(); ++e) {
+		Scene::Transform *transform = transforms[rotations.track[e]];
+		if (!transform) continue;
+		transform->rotation = glm::quat(rotations.value[3][e], rotations.value[0][e], rotations.value[1][e], rotations.value[2][e]);
+		transform->dirty = true;
+	}
+	for (uint32_t e = 0; e < scales.track.size(); ++e) {
+		Scene::Transform *transform = transforms[scales.track[e]];
+		if (!transform) continue;
+		transform->scale = glm::vec3(scales.value[0][e], scales.value[1][e], scales.value[2][e]);
+		transform->dirty = true;
+	}
+}
+
+void Animation::clear() {
+	track_transform.clear();
+	track_fps.clear();
+	track_time.clear();
+	positions.clear();
+	rotations.clear();
+	scales.clear();
+}
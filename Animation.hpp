@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+
+//"Animation" plays looping keyframe tracks on scene transforms.
+//Keys for all tracks are stored per component in flat arrays (structure-of-arrays),
+// so update() evaluates every animated transform in a few straight-line loops
+// (index computation, key gather, then blend) instead of per-object code.
+struct Animation {
+	//Add a track that animates 'transform':
+	// keys are sampled at 'fps' frames per second and the track loops;
+	// a channel given no keys is left alone (e.g. so gameplay code can keep moving a transform that only spins).
+	// 'time' (>= 0) is the starting time (in seconds) of the track, useful for de-synchronizing copies of the same animation.
+	void add_track(Scene &scene, Scene::Transform *transform, float fps,
+		std::vector< glm::vec3 > const &positions,
+		std::vector< glm::quat > const &rotations,
+		std::vector< glm::vec3 > const &scales,
+		float time = 0.0f);
+
+	//Advance all tracks by 'elapsed' seconds and write the results into their transforms:
+	// (tracks whose transforms have been deleted are skipped)
+	void update(Scene &scene, float elapsed);
+
+	//Remove all tracks:
+	void clear();
+
+	//internals:
+
+	//per-track data:
+	std::vector< Scene::TransformHandle > track_transform;
+	std::vector< float > track_fps;
+	std::vector< float > track_time;
+
+	//a channel holds the keys of one kind (position, rotation, or scale) for every track that has them:
+	template< uint32_t N >
+	struct Channel {
+		//per-entry (one entry per track with keys in this channel):
+		std::vector< uint32_t > track;
+		std::vector< uint32_t > first; //index of entry's first key
+		std::vector< uint32_t > count; //number of keys
+		//keys, one array per component:
+		std::vector< float > key[N];
+
+		//scratch (per-entry) used during update:
+		std::vector< float > a[N], b[N]; //keys to blend between
+		std::vector< float > t; //blend amount
+		std::vector< float > value[N]; //blended values
+
+		void add(uint32_t track_index, float const *keys, uint32_t key_count);
+		void clear();
+		//gather the keys on either side of each entry's track time into a and b:
+		void locate(Animation const &animation);
+	};
+	Channel< 3 > positions;
+	Channel< 4 > rotations; //(x,y,z,w)
+	Channel< 3 > scales;
+};
@@ -0,0 +1,22 @@
+#include "AssetRegistry.hpp"
+
+#include <iomanip>
+
+AssetRegistry asset_registry;
+
+void AssetRegistry::report(std::ostream &out) const {
+	std::lock_guard< std::mutex > lock(mutex);
+	size_t total = 0;
+	uint32_t shared = 0; //requests that didn't need a load
+	for (auto const &kv : entries) {
+		Entry const &entry = kv.second;
+		long holders = entry.asset.use_count();
+		out << "  " << std::setw(10) << entry.bytes << " bytes  " << holders << " holder" << (holders == 1 ? " " : "s")
+			<< "  " << entry.requests << " request" << (entry.requests == 1 ? " " : "s")
+			<< "  " << kv.first.second << (holders == 0 ? " [freed]" : "") << "\n";
+		if (holders != 0) total += entry.bytes;
+		if (entry.loads != 0) shared += entry.requests - entry.loads; //(requests for assets that never loaded weren't shared)
+	}
+	out << "  " << std::setw(10) << total << " bytes in " << entries.size() << " asset(s); "
+		<< shared << " duplicate request(s) shared an existing copy." << std::endl;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
+
+//"AssetRegistry" makes sure each asset file is only loaded once:
+// assets are keyed by (type, path); requesting an asset that is already loaded returns the loaded copy.
+// Assets are reference counted (std::shared_ptr); the registry only keeps a weak reference,
+// so an asset is freed when its last holder lets go (and will be reloaded if requested again).
+//
+//Usage:
+//  std::shared_ptr< MeshBuffer > meshes = asset_registry.acquire< MeshBuffer >(data_path("menu.p"));
+//  meshes->upload(); //(see upload_asset, below)
+//
+//Usually assets are acquired through Load< T > (see Load.hpp):
+//  Load< MeshBuffer > menu_meshes(LoadTagInit, "menu.p");
+//
+//Asset types must be constructible from a path and have a 'size_t bytes() const' member that reports their memory use.
+//acquire() is safe to call from any thread, so asset constructors must not use OpenGL; assets that need
+// OpenGL overload upload_asset(), which Load< T > calls on the main thread once the asset is constructed.
+//The registry is only locked to look up entries, not while assets are constructed, so different assets load in parallel;
+// requests for an asset that is still being loaded wait for that load to finish.
+
+struct AssetRegistry {
+	//return the asset of type T loaded from 'path', loading it (as T(path)) if it isn't already loaded:
+	template< typename T >
+	std::shared_ptr< T > acquire(std::string const &path);
+
+	//print path, holders, and memory use of every loaded asset:
+	void report(std::ostream &out) const;
+
+	//internals:
+	struct Entry {
+		std::weak_ptr< void > asset;
+		size_t bytes = 0; //as reported by the asset when it was loaded
+		uint32_t requests = 0; //number of times acquire() was called for this asset
+		uint32_t loads = 0; //number of times the asset was loaded (more than one if it was freed and requested again)
+		std::shared_future< std::shared_ptr< void > > pending; //valid while the asset is being loaded
+	};
+	std::map< std::pair< std::type_index, std::string >, Entry > entries; //(entries are never erased, so references to them stay valid)
+	mutable std::mutex mutex; //guards 'entries
+};
+
+extern AssetRegistry asset_registry;
+
+//finish loading an asset on the thread with the OpenGL context (does nothing unless overloaded for T):
+template< typename T >
+void upload_asset(T &) {
+}
+
+template< typename T >
+std::shared_ptr< T > AssetRegistry::acquire(std::string const &path) {
+	std::promise< std::shared_ptr< void > > promise;
+	std::shared_future< std::shared_ptr< void > > pending;
+	Entry *entry = nullptr;
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		entry = &entries[std::make_pair(std::type_index(typeid(T)), path)];
+		entry->requests += 1;
+		std::shared_ptr< void > existing = entry->asset.lock();
+		if (existing) {
+			return std::static_pointer_cast< T >(existing);
+		}
+		if (entry->pending.valid()) {
+			pending = entry->pending; //another thread is loading the asset
+		} else {
+			entry->pending = promise.get_future().share(); //this thread will load it
+		}
+	}
+	if (pending.valid()) {
+		return std::static_pointer_cast< T >(pending.get()); //(rethrows if the load failed)
+	}
+
+	std::shared_ptr< T > asset;
+	try {
+		asset = std::make_shared< T >(path);
+	} catch (...) {
+		{
+			std::lock_guard< std::mutex > lock(mutex);
+			entry->pending = std::shared_future< std::shared_ptr< void > >();
+		}
+		promise.set_exception(std::current_exception());
+		throw;
+	}
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		entry->asset = asset;
+		entry->loads += 1;
+		entry->bytes = asset->bytes();
+		entry->pending = std::shared_future< std::shared_ptr< void > >();
+	}
+	promise.set_value(asset);
+	return asset;
+}
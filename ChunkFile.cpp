@@ -0,0 +1,37 @@
+#include "ChunkFile.hpp"
+
+ChunkFile::ChunkFile(std::string const &filename_) : filename(filename_), file(filename_) {
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	//index headers (only the headers' pages are touched):
+	char const *at = file.begin();
+	char const *end = file.end();
+	while (at != end) {
+		ChunkHeader header;
+		if (size_t(end - at) < sizeof(header)) {
+			throw std::runtime_error("Truncated chunk header at offset " + std::to_string(at - file.begin()) + " in '" + filename + "'.");
+		}
+		std::memcpy(&header, at, sizeof(header));
+		if (size_t(end - at) - sizeof(header) < header.size) {
+			throw std::runtime_error("Truncated '" + std::string(header.magic, 4) + "' chunk in '" + filename + "'.");
+		}
+		Chunk chunk;
+		std::memcpy(chunk.magic, header.magic, 4);
+		chunk.size = header.size;
+		chunk.offset = size_t(at - file.begin()) + sizeof(header);
+		chunks.emplace_back(chunk);
+		at += sizeof(header) + header.size;
+	}
+}
+
+ChunkFile::Chunk const *ChunkFile::find(std::string const &magic) const {
+	if (magic.size() != 4) return nullptr;
+	for (auto const &chunk : chunks) {
+		if (std::memcmp(chunk.magic, magic.data(), 4) == 0) return &chunk;
+	}
+	return nullptr;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "MappedFile.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//"ChunkFile" gives random access to the chunks of a file in the format read by read_chunk
+// (a sequence of chunks, each a 4-byte magic number, a uint32_t size, and 'size' bytes of data):
+// the file is mapped (see MappedFile.hpp) and its chunk headers are indexed once, when it is opened.
+// Chunks can then be looked up by magic in any order; chunks that aren't asked for are skipped,
+// and a chunk's data isn't read from disk until it is used.
+//
+//Usage:
+//  ChunkFile file(data_path("level.scene"));
+//  std::vector< Entry > entries;
+//  file.read("ent0", &entries); //copy a chunk into a vector
+//  char const *data; size_t count;
+//  file.span< Vertex >("vtx0", &data, &count); //or use it in place
+//
+// note: the constructor will throw if the file can't be opened or ends partway through a chunk;
+//  lookups will throw if the chunk is missing or malformed.
+
+struct ChunkFile {
+	ChunkFile(std::string const &filename);
+
+	struct Chunk {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0; //bytes of data
+		size_t offset = 0; //of data, from the start of the file
+	};
+	std::vector< Chunk > chunks; //in file order
+
+	//first chunk with the given magic, or nullptr if there is none:
+	Chunk const *find(std::string const &magic) const;
+
+	//a chunk's data in place (in the mapped file, so not copied, and not necessarily aligned for T; use memcpy to access it):
+	// sets *_data to the data and *_count to the number of T's it holds.
+	template< typename T >
+	void span(std::string const &magic, char const **_data, size_t *_count) const;
+
+	//as above, but copies the chunk's data into a vector:
+	template< typename T >
+	void read(std::string const &magic, std::vector< T > *_to) const;
+
+	std::string filename;
+	MappedFile file;
+};
+
+template< typename T >
+void ChunkFile::span(std::string const &magic, char const **_data, size_t *_count) const {
+	assert(_data);
+	assert(_count);
+	Chunk const *chunk = find(magic);
+	if (!chunk) {
+		throw std::runtime_error("Missing '" + magic + "' chunk in '" + filename + "'.");
+	}
+	if (chunk->size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of '" + magic + "' chunk in '" + filename + "' not divisible by element size.");
+	}
+	*_data = file.begin() + chunk->offset;
+	*_count = chunk->size / sizeof(T);
+}
+
+template< typename T >
+void ChunkFile::read(std::string const &magic, std::vector< T > *_to) const {
+	assert(_to);
+	char const *data = nullptr;
+	size_t count = 0;
+	span< T >(magic, &data, &count);
+	_to->resize(count);
+	if (count) std::memcpy(&(*_to)[0], data, count * sizeof(T));
+}
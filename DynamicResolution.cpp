@@ -0,0 +1,99 @@
+#include "DynamicResolution.hpp"
+
+#include "gl_errors.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+DynamicResolution dynamic_resolution;
+
+glm::uvec2 DynamicResolution::begin(glm::uvec2 const &drawable_size) {
+	if (allocated_size != drawable_size) {
+		release();
+		allocated_size = drawable_size;
+
+		glGenRenderbuffers(1, &color_renderbuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, color_renderbuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, allocated_size.x, allocated_size.y);
+
+		glGenRenderbuffers(1, &depth_renderbuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, depth_renderbuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, allocated_size.x, allocated_size.y);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_renderbuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_renderbuffer);
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (status != GL_FRAMEBUFFER_COMPLETE) {
+			throw std::runtime_error("Dynamic resolution framebuffer is incomplete.");
+		}
+
+		GL_ERRORS();
+	}
+
+	if (!enabled) scale = max_scale;
+	render_size.x = std::max(1U, std::min(drawable_size.x, uint32_t(std::round(drawable_size.x * scale))));
+	render_size.y = std::max(1U, std::min(drawable_size.y, uint32_t(std::round(drawable_size.y * scale))));
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, render_size.x, render_size.y);
+	//(only the part of the target in use needs clearing)
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(0, 0, render_size.x, render_size.y);
+	glClearColor(0.5, 0.5, 0.5, 0.0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glDisable(GL_SCISSOR_TEST);
+
+	return render_size;
+}
+
+void DynamicResolution::end(glm::uvec2 const &drawable_size) {
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(
+		0, 0, render_size.x, render_size.y,
+		0, 0, drawable_size.x, drawable_size.y,
+		GL_COLOR_BUFFER_BIT, (render_size == drawable_size ? GL_NEAREST : GL_LINEAR)
+	);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, drawable_size.x, drawable_size.y);
+}
+
+void DynamicResolution::report_frame_time(float seconds) {
+	//smooth out single-frame hitches:
+	if (frame_time == 0.0f) frame_time = seconds;
+	else frame_time += 0.1f * (seconds - frame_time);
+
+	if (!enabled) return;
+
+	//render cost is roughly proportional to pixel count (scale^2), so step scale by the square root of the ratio;
+	// the band around the target keeps scale from oscillating (e.g. when frame time is pinned by vsync):
+	float ratio = target_frame_time / std::max(frame_time, 1e-4f);
+	if (ratio < 0.95f || ratio > 1.2f) {
+		float step = std::sqrt(ratio);
+		//move only part of the way per frame, since the smoothed time lags behind changes:
+		scale *= 1.0f + 0.05f * (step - 1.0f);
+		scale = std::max(min_scale, std::min(max_scale, scale));
+	}
+}
+
+void DynamicResolution::release() {
+	if (framebuffer) {
+		glDeleteFramebuffers(1, &framebuffer);
+		framebuffer = 0;
+	}
+	if (color_renderbuffer) {
+		glDeleteRenderbuffers(1, &color_renderbuffer);
+		color_renderbuffer = 0;
+	}
+	if (depth_renderbuffer) {
+		glDeleteRenderbuffers(1, &depth_renderbuffer);
+		depth_renderbuffer = 0;
+	}
+	allocated_size = glm::uvec2(0);
+}
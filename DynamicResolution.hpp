@@ -0,0 +1,49 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+//"DynamicResolution" renders frames into an offscreen target at a fraction of the window's resolution,
+// then upscales them into the window. The fraction ('scale') is adjusted from measured frame times
+// so that frames stay near 'target_frame_time'.
+//
+//Usage (each frame, on the thread with the OpenGL context):
+//  glm::uvec2 render_size = dynamic_resolution.begin(drawable_size);
+//  ... draw at render_size ...
+//  dynamic_resolution.end(drawable_size);
+//  dynamic_resolution.report_frame_time(seconds);
+
+struct DynamicResolution {
+	//settings:
+	bool enabled = true; //if false, scale stays at max_scale
+	float target_frame_time = 1.0f / 60.0f; //seconds
+	float min_scale = 0.5f;
+	float max_scale = 1.0f;
+
+	//current state (for monitoring):
+	float scale = 1.0f; //fraction of drawable size (in each dimension) currently rendered
+	float frame_time = 0.0f; //smoothed frame time (seconds)
+	glm::uvec2 render_size = glm::uvec2(0); //size of most recent frame
+
+	//bind (and clear) the offscreen target and set the viewport for this frame; returns the size to draw at:
+	glm::uvec2 begin(glm::uvec2 const &drawable_size);
+	//upscale the frame into the default framebuffer and restore the viewport:
+	void end(glm::uvec2 const &drawable_size);
+
+	//feed in the duration of the most recent frame (adjusts scale):
+	void report_frame_time(float seconds);
+
+	//free OpenGL objects (call before destroying the context):
+	void release();
+
+	//internals:
+	//the target is allocated at full drawable size; frames use its lower-left corner,
+	// so changing scale never reallocates:
+	GLuint framebuffer = 0;
+	GLuint color_renderbuffer = 0;
+	GLuint depth_renderbuffer = 0;
+	glm::uvec2 allocated_size = glm::uvec2(0);
+};
+
+extern DynamicResolution dynamic_resolution;
@@ -11,43 +11,35 @@
 #include "compile_program.hpp" //helper to compile opengl shader programs
 #include "draw_text.hpp" //helper to... um.. draw text
 #include "vertex_color_program.hpp"
+#include "depth_program.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
 #include <iostream>
 #include <fstream>
+#include <iomanip>
+#include <sstream>
 #include <map>
 #include <cstddef>
 #include <random>
+#include <algorithm>
 
-Load< MeshBuffer > game_meshes(LoadTagDefault, [](){
-	return new MeshBuffer(data_path("meshes.pnc"));
-});
+Load< MeshBuffer > game_meshes(LoadTagDefault, "meshes.qpnc");
 
-Load<WalkMesh> walk_mesh(LoadTagDefault, []() {
-  return new WalkMesh(data_path("walkmesh.blob"));
-});
+Load< WalkMesh > walk_mesh(LoadTagDefault, "walkmesh.blob");
 
 Load< GLuint > game_meshes_for_vertex_color_program(LoadTagDefault, [](){
-	return new GLuint(game_meshes->make_vao_for_program(vertex_color_program->program));
+	return new GLuint(game_meshes->vao_for_program(vertex_color_program->program));
 });
 
-Load< Sound::Sample > sample_loop(LoadTagDefault, [](){
-	return new Sound::Sample(data_path("loop.wav"));
-});
+Load< Sound::Sample > sample_loop(LoadTagDefault, "loop.wav");
 
-Load< Sound::Sample > sample_blood(LoadTagDefault, [](){
-	//all are creative commons liscenced sounds I found online
-	return new Sound::Sample(data_path("blood.wav"));
-});
+//all are creative commons liscenced sounds I found online
+Load< Sound::Sample > sample_blood(LoadTagDefault, "blood.wav");
 
-Load< Sound::Sample > sample_vom(LoadTagDefault, [](){
-	return new Sound::Sample(data_path("vomit.wav"));
-});
+Load< Sound::Sample > sample_vom(LoadTagDefault, "vomit.wav");
 
-Load< Sound::Sample > sample_mop(LoadTagDefault, [](){
-	return new Sound::Sample(data_path("mop.wav"));
-});
+Load< Sound::Sample > sample_mop(LoadTagDefault, "mop.wav");
 
 
 glm::vec3 random_coord() {
@@ -81,21 +73,46 @@ bool intersect(glm::vec3 p1, glm::vec3 p2) {
 	} else return false;
 }
 
-JanitorMode::JanitorMode() {
+JanitorMode::JanitorMode() : drawable_aspect(1.0f) {
 	//----------------
 	//set up scene:
 	srand(time(NULL));
+	scene.update_pool = &update_pool;
+
+	{ //material shared by all the vertex-colored meshes:
+		material = scene.new_material();
+		material->program = vertex_color_program->program;
+		material->program_matrices_block = vertex_color_program->object_matrices_block;
+		//light position + color:
+		material->set_uniform(vertex_color_program->sun_color_vec3, glm::vec3(0.81f, 0.81f, 0.76f));
+		material->set_uniform(vertex_color_program->sun_direction_vec3, glm::normalize(glm::vec3(-0.2f, 0.2f, 1.0f)));
+		material->set_uniform(vertex_color_program->sky_color_vec3, glm::vec3(0.4f, 0.4f, 0.45f));
+		material->set_uniform(vertex_color_program->sky_direction_vec3, glm::vec3(0.0f, 1.0f, 0.0f));
+	}
 
 	auto attach_object = [this](Scene::Transform *transform, std::string const &name) {
 		Scene::Object *object = scene.new_object(transform);
-		object->program = vertex_color_program->program;
-		object->program_mvp_mat4 = vertex_color_program->object_to_clip_mat4;
-		object->program_mv_mat4x3 = vertex_color_program->object_to_light_mat4x3;
-		object->program_itmv_mat3 = vertex_color_program->normal_to_light_mat3;
+		object->material = material;
 		object->vao = *game_meshes_for_vertex_color_program;
-		MeshBuffer::Mesh const &mesh = game_meshes->lookup(name);
-		object->start = mesh.start;
-		object->count = mesh.count;
+		object->mesh_buffer = &(*game_meshes);
+		std::vector< MeshBuffer::Mesh > lods = game_meshes->lookup_lods(name);
+		object->start = lods[0].start;
+		object->count = lods[0].count;
+		object->index_type = game_meshes->index_type;
+		object->position_scale = lods[0].position_scale;
+		object->position_bias = lods[0].position_bias;
+		if (lods.size() > 1) {
+			for (auto const &mesh : lods) {
+				object->lods.emplace_back();
+				object->lods.back().start = mesh.start;
+				object->lods.back().count = mesh.count;
+				object->lods.back().position_scale = mesh.position_scale;
+				object->lods.back().position_bias = mesh.position_bias;
+			}
+		}
+		//bounds (for level of detail and culling):
+		object->lod_center = lods[0].center;
+		object->lod_radius = lods[0].radius;
 		return object;
 	};
 
@@ -121,6 +138,7 @@ JanitorMode::JanitorMode() {
 		transform1->position = glm::vec3(0.0f, 0.0f, 0.0f);
 		transform1->rotation = glm::angleAxis(float(2 * M_PI), glm::vec3(0.0f, 0.0f, 1.0f));
 		large_crate = attach_object(transform1, "Floor");
+		large_crate->is_static = true; //the floor never moves
 
 		Scene::Transform *transform2 = scene.new_transform();
 		transform2->position = world_point;
@@ -147,11 +165,34 @@ JanitorMode::JanitorMode() {
 		transform->rotation = glm::angleAxis(-glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 		camera = scene.new_camera(transform);
 	}
+
+	{ //Minimap camera (cameras look along -z, so no rotation is needed to look down):
+		Scene::Transform *transform = scene.new_transform();
+		minimap_camera = scene.new_camera(transform);
+	}
+
+	{ //spills slowly swell and settle (scale only, since pickups move them):
+		std::vector< glm::vec3 > swell{
+			glm::vec3(1.0f, 1.0f, 1.0f),
+			glm::vec3(1.06f, 1.06f, 1.3f),
+			glm::vec3(1.0f, 1.0f, 1.0f),
+			glm::vec3(0.96f, 0.96f, 0.85f),
+		};
+		animation.add_track(scene, vomit->transform, 2.0f, {}, {}, swell);
+		animation.add_track(scene, blood->transform, 2.0f, {}, {}, swell, 0.7f);
+	}
+
+	//merge static geometry (the floor) into world-space buffers:
+	scene.bake_static();
+
+	//draw ordering (toggled with F1/F2 to compare fill cost):
+	scene.sort_front_to_back = true;
+	scene.depth_prepass_program = depth_program->program;
 	
 	//start the 'loop' sample playing at the large crate:
 	loop = sample_loop->play(large_crate->transform->position, 1.0f, Sound::Loop);
 
-
+	save_checkpoint(&start);
 }
 
 JanitorMode::~JanitorMode() {
@@ -184,6 +225,21 @@ bool JanitorMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_si
 		// 	return true;
 		// }
 	}
+	//rendering toggles (their effect shows in the stats line, so they also turn it on):
+	if (evt.type == SDL_KEYDOWN && evt.key.keysym.scancode == SDL_SCANCODE_F1) {
+		scene.sort_front_to_back = !scene.sort_front_to_back;
+		show_stats = true;
+		return true;
+	}
+	if (evt.type == SDL_KEYDOWN && evt.key.keysym.scancode == SDL_SCANCODE_F2) {
+		scene.depth_prepass = !scene.depth_prepass;
+		show_stats = true;
+		return true;
+	}
+	if (evt.type == SDL_KEYDOWN && evt.key.keysym.scancode == SDL_SCANCODE_F3) {
+		show_stats = !show_stats;
+		return true;
+	}
 	//handle tracking the mouse for rotation control:
 	// if (!mouse_captured) {
 	if (evt.type == SDL_KEYDOWN && evt.key.keysym.scancode == SDL_SCANCODE_ESCAPE) {
@@ -220,6 +276,11 @@ bool JanitorMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_si
 }
 
 void JanitorMode::update(float elapsed) {
+	frame_ms = glm::mix(frame_ms, elapsed * 1000.0f, 0.1f);
+
+	animation.update(scene, elapsed);
+	minimap_camera->transform->position = player->transform->position + glm::vec3(0.0f, 0.0f, 30.0f);
+
 	if (win) show_win();
 	if (game_time > 0) game_time -= elapsed;
 	else lose = true;
@@ -234,7 +295,17 @@ void JanitorMode::update(float elapsed) {
 	}
 
 	if (!mop_dirty){
-		if (intersect(player->transform->position, 
+		//only messes filed near the player need the exact intersection test:
+		// (the grid is refreshed first, so it reflects the animation above and messes moved last frame;
+		//  only transforms that changed are recomputed, and extract() then has little left to do)
+		scene.update_transforms(&update_pool);
+		std::vector< Scene::Object * > nearby;
+		scene.query_radius(player->transform->position, 2.0f, &nearby);
+		auto is_nearby = [&nearby](Scene::Object *object) {
+			return std::find(nearby.begin(), nearby.end(), object) != nearby.end();
+		};
+
+		if (is_nearby(vomit) && intersect(player->transform->position, 
 		vomit->transform->position)) {
 			glm::vec3 vom_norm;
 			glm::vec3 vom_point = random_coord();
@@ -250,7 +321,7 @@ void JanitorMode::update(float elapsed) {
 			glm::mat4x3 to_world = camera->transform->make_local_to_world();
 			sample_vom->play(to_world * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f) );
 		}
-		if (intersect(player->transform->position, 
+		if (is_nearby(blood) && intersect(player->transform->position, 
 			blood->transform->position)) {
 			glm::vec3 blood_norm;
 			glm::vec3 blood_point = random_coord();
@@ -324,14 +395,15 @@ void JanitorMode::update(float elapsed) {
 		player->transform->rotation = glm::normalize(glm::angleAxis(0.0f, normal_vector) *
                      glm::angleAxis(magnitude, right_vector));
 		set_rotation(camera->transform, glm::vec3(0.0f, 0.0f, 1.0f));
-		player->program = vertex_color_program->program;
-		player->program_mvp_mat4 = vertex_color_program->object_to_clip_mat4;
-		player->program_mv_mat4x3 = vertex_color_program->object_to_light_mat4x3;
-		player->program_itmv_mat3 = vertex_color_program->normal_to_light_mat3;
+		player->material = material;
 		player->vao = *game_meshes_for_vertex_color_program;
 		MeshBuffer::Mesh const &mesh = game_meshes->lookup("Player_Lose");
 		player->start = mesh.start;
 		player->count = mesh.count;
+		player->index_type = game_meshes->index_type;
+		player->position_scale = mesh.position_scale;
+		player->position_bias = mesh.position_bias;
+		player->lods.clear();
 		show_lose();
 	}
 
@@ -346,66 +418,141 @@ void JanitorMode::update(float elapsed) {
 		player->transform->rotation = glm::normalize(glm::angleAxis(0.0f, normal_vector) *
                      glm::angleAxis(magnitude, right_vector));
 		set_rotation(camera->transform, glm::vec3(0.0f, 0.0f, 1.0f));
-		player->program = vertex_color_program->program;
-		player->program_mvp_mat4 = vertex_color_program->object_to_clip_mat4;
-		player->program_mv_mat4x3 = vertex_color_program->object_to_light_mat4x3;
-		player->program_itmv_mat3 = vertex_color_program->normal_to_light_mat3;
+		player->material = material;
 		player->vao = *game_meshes_for_vertex_color_program;
 		MeshBuffer::Mesh const &mesh = game_meshes->lookup("Player_Win");
 		player->start = mesh.start;
 		player->count = mesh.count;
+		player->index_type = game_meshes->index_type;
+		player->position_scale = mesh.position_scale;
+		player->position_bias = mesh.position_bias;
+		player->lods.clear();
 		show_win();
 	}
 }
 
 void JanitorMode::draw(glm::uvec2 const &drawable_size) {
-	//set up basic OpenGL state:
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_BLEND);
-	glBlendEquation(GL_FUNC_ADD);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-	//set up light position + color:
-	glUseProgram(vertex_color_program->program);
-	glUniform3fv(vertex_color_program->sun_color_vec3, 1, glm::value_ptr(glm::vec3(0.81f, 0.81f, 0.76f)));
-	glUniform3fv(vertex_color_program->sun_direction_vec3, 1, glm::value_ptr(glm::normalize(glm::vec3(-0.2f, 0.2f, 1.0f))));
-	glUniform3fv(vertex_color_program->sky_color_vec3, 1, glm::value_ptr(glm::vec3(0.4f, 0.4f, 0.45f)));
-	glUniform3fv(vertex_color_program->sky_direction_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 1.0f, 0.0f)));
-	glUseProgram(0);
-
-	//fix aspect ratio of camera
-	camera->aspect = drawable_size.x / float(drawable_size.y);
-
-	scene.draw(camera);
-
-	if (Mode::current.get() == this) {
-		glDisable(GL_DEPTH_TEST);
-		std::string help_message;
-		if (!mop_dirty) help_message = "USE WASD TO MOVE";
-		else help_message = "YOUR MOP IS DIRTY!";
-		float height = 0.06f;
-		float width = text_width(help_message, height);
-		draw_text(help_message, glm::vec2(-0.5f * width,-0.99f), height, glm::vec4(0.0f, 0.0f, 0.0f, 0.5f));
-		draw_text(help_message, glm::vec2(-0.5f * width,-1.0f), height, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-
-
-		std::string time_str = std::to_string((int)game_time);
-		height = 0.1f;
-		width = text_width(time_str, height);
-		draw_text(time_str, glm::vec2(1.0f,0.8f), height, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-		
-		std::string score_str = std::to_string(score);
-		std::string score_msg = "SCORE ";
-		height = 0.05f;
-		width = text_width(score_msg, height);
-		draw_text(score_msg, glm::vec2(0.6f,0.7f), height, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-		height = 0.1f;
-		width = text_width(score_str, height);
-		draw_text(score_str, glm::vec2(1.0f,0.68f), height, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-		glUseProgram(0);
+	extract()(drawable_size);
+}
+
+Mode::RenderFunction JanitorMode::extract() {
+	snapshot_index = (snapshot_index + 1) % 2;
+	Scene::RenderSnapshot *snapshot = &snapshots[snapshot_index];
+
+	bool show_hud = (Mode::current.get() == this);
+
+	//main view, plus a minimap in the upper left while playing:
+	// (views are resized rather than rebuilt so their draw lists keep their storage)
+	float aspect = drawable_aspect.load();
+	snapshot->views.resize(show_hud ? 2 : 1);
+	{
+		Scene::View &view = snapshot->views[0];
+		view.camera = camera;
+		view.aspect = aspect;
+	}
+	if (show_hud) {
+		Scene::View &view = snapshot->views[1];
+		view.camera = minimap_camera;
+		float height = 0.3f;
+		view.min = glm::vec2(0.02f, 0.68f);
+		view.max = view.min + glm::vec2(height / aspect, height);
+		view.aspect = 1.0f;
+		view.clear_depth = true;
+	}
+	scene.extract(snapshot);
+
+	std::string help_message = (mop_dirty ? "YOUR MOP IS DIRTY!" : "USE WASD TO MOVE");
+	std::string time_str = std::to_string((int)game_time);
+	std::string score_str = std::to_string(score);
+
+	//first part of the stats line (the draw counts are only known once the snapshot is drawn):
+	std::string stats_str;
+	if (show_stats) {
+		std::ostringstream str;
+		str << std::fixed << std::setprecision(1) << frame_ms << " MS"
+			<< " SORT " << (scene.sort_front_to_back ? "ON" : "OFF")
+			<< " PREPASS " << (scene.depth_prepass ? "ON" : "OFF");
+		stats_str = str.str();
 	}
 
-	GL_ERRORS();
+	//the snapshot holds a reference to the mode so the scene (and its OpenGL objects) outlive it:
+	std::shared_ptr< JanitorMode > self = std::static_pointer_cast< JanitorMode >(shared_from_this());
+	return [self, snapshot, show_hud, help_message, time_str, score_str, stats_str](glm::uvec2 const &drawable_size) {
+		//set up basic OpenGL state:
+		glEnable(GL_DEPTH_TEST);
+		glEnable(GL_BLEND);
+		glBlendEquation(GL_FUNC_ADD);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+		//projection aspect ratios come from the drawable:
+		self->drawable_aspect.store(drawable_size.x / float(drawable_size.y));
+		self->scene.draw(*snapshot, drawable_size);
+
+		if (show_hud) {
+			glDisable(GL_DEPTH_TEST);
+			float height = 0.06f;
+			float width = text_width(help_message, height);
+			draw_text(help_message, glm::vec2(-0.5f * width,-0.99f), height, glm::vec4(0.0f, 0.0f, 0.0f, 0.5f));
+			draw_text(help_message, glm::vec2(-0.5f * width,-1.0f), height, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+
+			height = 0.1f;
+			draw_text(time_str, glm::vec2(1.0f,0.8f), height, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+
+			std::string score_msg = "SCORE ";
+			height = 0.05f;
+			draw_text(score_msg, glm::vec2(0.6f,0.7f), height, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+			height = 0.1f;
+			draw_text(score_str, glm::vec2(1.0f,0.68f), height, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+
+			if (!stats_str.empty()) {
+				//(draw_stats was just written by scene.draw on this thread)
+				Scene::DrawStats const &stats = self->scene.draw_stats;
+				std::string line = stats_str
+					+ " " + std::to_string(stats.objects) + " OBJECTS"
+					+ " " + std::to_string(stats.draws) + " DRAWS"
+					+ " " + std::to_string(stats.prepass_draws) + " PREPASS DRAWS"
+					+ " " + std::to_string(stats.triangles) + " TRIS";
+				height = 0.04f;
+				width = text_width(line, height);
+				draw_text(line, glm::vec2(-0.5f * width,-0.9f), height, glm::vec4(1.0f, 1.0f, 0.5f, 1.0f));
+			}
+			glUseProgram(0);
+		}
+
+		GL_ERRORS();
+	};
+}
+
+void JanitorMode::save_checkpoint(Checkpoint *checkpoint) const {
+	assert(checkpoint);
+	scene.save(&checkpoint->scene);
+	checkpoint->wp = wp;
+	checkpoint->player_pos = player_pos;
+	checkpoint->win = win;
+	checkpoint->lose = lose;
+	checkpoint->mop_dirty = mop_dirty;
+	checkpoint->game_time = game_time;
+	checkpoint->messes_cleaned = messes_cleaned;
+	checkpoint->score = score;
+}
+
+void JanitorMode::restore_checkpoint(Checkpoint const &checkpoint) {
+	//NOTE: scene structure doesn't change during play, so this keeps camera/player/etc pointers valid:
+	scene.restore(checkpoint.scene);
+	wp = checkpoint.wp;
+	player_pos = checkpoint.player_pos;
+	win = checkpoint.win;
+	lose = checkpoint.lose;
+	mop_dirty = checkpoint.mop_dirty;
+	game_time = checkpoint.game_time;
+	messes_cleaned = checkpoint.messes_cleaned;
+	score = checkpoint.score;
+}
+
+void JanitorMode::restart() {
+	restore_checkpoint(start);
+	controls.forward = controls.backward = controls.left = controls.right = false;
+	Mode::set_current(shared_from_this());
 }
 
 void JanitorMode::show_win(){
@@ -415,6 +562,10 @@ void JanitorMode::show_win(){
 	menu->background = game;
 
 	menu->choices.emplace_back("YOU WIN!!!");
+	menu->choices.emplace_back("RESTART", [this](){
+		restart();
+	});
+	menu->selected = 1;
 
 	Mode::set_current(menu);
 }
@@ -426,6 +577,10 @@ void JanitorMode::show_lose(){
 	menu->background = game;
 
 	menu->choices.emplace_back("YOU LOSE");
+	menu->choices.emplace_back("RESTART", [this](){
+		restart();
+	});
+	menu->selected = 1;
 
 	Mode::set_current(menu);
 
@@ -442,6 +597,9 @@ void JanitorMode::show_pause_menu() {
 	menu->choices.emplace_back("RESUME", [game](){
 		Mode::set_current(game);
 	});
+	menu->choices.emplace_back("RESTART", [this](){
+		restart();
+	});
 	menu->choices.emplace_back("QUIT", [](){
 		Mode::set_current(nullptr);
 	});
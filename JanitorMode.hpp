@@ -7,12 +7,15 @@
 #include "MeshBuffer.hpp"
 #include "GL.hpp"
 #include "Scene.hpp"
+#include "Animation.hpp"
 #include "Sound.hpp"
+#include "ThreadPool.hpp"
 
 #include <SDL.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <atomic>
 #include <vector>
 
 // The 'JanitorMode' shows scene with some crates in it:
@@ -32,7 +35,10 @@ struct JanitorMode : public Mode {
 	//draw is called after update:
 	virtual void draw(glm::uvec2 const &drawable_size) override;
 
-	//starts up a 'quit/resume' pause menu:
+	//extract copies the scene view and HUD into a render snapshot:
+	virtual RenderFunction extract() override;
+
+	//starts up a 'quit/resume/restart' pause menu:
 	void show_pause_menu();
 	void show_win();
 	void show_lose();
@@ -46,8 +52,26 @@ struct JanitorMode : public Mode {
 
 	bool mouse_captured = false;
 
+	//rendering statistics line in the HUD (F3 toggles it; the F1/F2 rendering toggles also turn it on):
+	bool show_stats = false;
+	float frame_ms = 0.0f; //recent average time between updates
+
+	//threads for updating scene transforms (used through scene.update_pool):
+	ThreadPool update_pool;
+
 	Scene scene;
 	Scene::Camera *camera = nullptr;
+	Scene::Camera *minimap_camera = nullptr; //looks down on the player
+	Scene::Material *material = nullptr; //vertex color material shared by all objects
+
+	//double-buffered so one snapshot can be drawn while the next is extracted:
+	Scene::RenderSnapshot snapshots[2];
+	uint32_t snapshot_index = 0;
+	//aspect of the most recently drawn frame (written by the render thread, used to cull the next snapshot):
+	std::atomic< float > drawable_aspect;
+
+	//keyframed props (updated every frame):
+	Animation animation;
 
 	Scene::Object *large_crate = nullptr;
 	Scene::Object *player = nullptr;
@@ -70,4 +94,22 @@ struct JanitorMode : public Mode {
 	uint messes_cleaned = 0;
 	uint score = 0;
 
+	//a Checkpoint is a copy of the scene and game state, used for restarting:
+	struct Checkpoint {
+		Scene::Snapshot scene;
+		WalkMesh::WalkPoint wp;
+		glm::vec3 player_pos;
+		bool win, lose, mop_dirty;
+		float game_time;
+		uint messes_cleaned, score;
+	};
+	void save_checkpoint(Checkpoint *checkpoint) const;
+	void restore_checkpoint(Checkpoint const &checkpoint);
+
+	//state at the start of the game (saved at the end of the constructor):
+	Checkpoint start;
+
+	//return to 'start' and resume play:
+	void restart();
+
 };
@@ -1,28 +1,166 @@
 #include "Load.hpp"
 
+#include <algorithm>
 #include <array>
-#include <list>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace {
-	std::array< std::list< std::function< void() > >, LoadTagCount > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, LoadTagCount > load_lists;
-		return load_lists;
+	struct LoadFunction {
+		std::function< void() > cpu; //(may be empty)
+		std::function< void() > gl; //(may be empty)
+		std::atomic< bool > cpu_done{false};
+		std::exception_ptr cpu_error; //set if cpu stage threw (rethrown on the main thread)
+	};
+
+	struct Loads {
+		std::array< std::list< std::shared_ptr< LoadFunction > >, LoadTagCount > lists;
+		uint32_t added = 0;
+		uint32_t finished = 0;
+
+		//background loading state:
+		bool started = false;
+		std::mutex mutex; //guards 'queue' and 'idle_workers'
+		std::deque< std::shared_ptr< LoadFunction > > queue; //cpu stages waiting for a worker
+		std::vector< std::thread > workers;
+		uint32_t idle_workers = 0; //workers that have exited because the queue was empty
+
+		//join workers, if all have exited (must hold 'mutex'):
+		void join_idle_workers() {
+			if (idle_workers != workers.size()) return;
+			for (auto &thread : workers) thread.join();
+			workers.clear();
+			idle_workers = 0;
+		}
+
+		~Loads() {
+			//(workers exit once the queue is empty)
+			for (auto &thread : workers) thread.join();
+		}
+	};
+
+	Loads &get_loads() {
+		static Loads loads;
+		return loads;
+	}
+
+	void run_cpu(LoadFunction &fn) {
+		try {
+			fn.cpu();
+		} catch (...) {
+			fn.cpu_error = std::current_exception();
+		}
+		fn.cpu_done = true;
+	}
+
+	void worker() {
+		Loads &loads = get_loads();
+		while (true) {
+			std::shared_ptr< LoadFunction > fn;
+			{
+				std::unique_lock< std::mutex > lock(loads.mutex);
+				if (loads.queue.empty()) {
+					loads.idle_workers += 1;
+					return;
+				}
+				fn = loads.queue.front();
+				loads.queue.pop_front();
+			}
+			run_cpu(*fn);
+		}
+	}
+
+	//queue a cpu stage, starting more workers if some have exited:
+	void enqueue(std::shared_ptr< LoadFunction > const &fn) {
+		Loads &loads = get_loads();
+		uint32_t hardware = std::thread::hardware_concurrency();
+		uint32_t target = (hardware > 2 ? hardware - 1 : 1); //(leave a thread for GL stages)
+		std::unique_lock< std::mutex > lock(loads.mutex);
+		loads.queue.emplace_back(fn);
+		if (loads.workers.size() - loads.idle_workers < target) {
+			loads.join_idle_workers();
+			loads.workers.emplace_back(worker);
+		}
 	}
 }
 
 void add_load_function(LoadTag tag, std::function< void() > const &fn) {
-	auto &load_lists = get_load_lists();
-	assert(tag < load_lists.size());
-	load_lists[tag].emplace_back(fn);
+	add_load_function(tag, std::function< void() >(), fn);
+}
+
+void add_load_function(LoadTag tag, std::function< void() > const &cpu_fn, std::function< void() > const &gl_fn) {
+	Loads &loads = get_loads();
+	assert(tag < loads.lists.size());
+	std::shared_ptr< LoadFunction > fn = std::make_shared< LoadFunction >();
+	fn->cpu = cpu_fn;
+	fn->gl = gl_fn;
+	if (!fn->cpu) fn->cpu_done = true;
+	loads.lists[tag].emplace_back(fn);
+	loads.added += 1;
+	if (loads.started && fn->cpu) enqueue(fn);
 }
 
 void call_load_functions() {
-	auto &load_lists = get_load_lists();
-	for (auto &fn_list : load_lists) {
+	start_load_functions();
+	while (update_load_functions(std::numeric_limits< float >::infinity()) < 1.0f) {
+		//waiting on cpu stages:
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+void start_load_functions() {
+	Loads &loads = get_loads();
+	if (loads.started) return;
+	loads.started = true;
+	for (auto &fn_list : loads.lists) {
+		for (auto &fn : fn_list) {
+			if (fn->cpu) enqueue(fn);
+		}
+	}
+}
+
+float update_load_functions(float budget) {
+	Loads &loads = get_loads();
+	assert(loads.started && "start_load_functions() must be called before update_load_functions().");
+	auto before = std::chrono::high_resolution_clock::now();
+	for (auto &fn_list : loads.lists) {
 		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
+			LoadFunction &fn = *fn_list.front();
+			if (!fn.cpu_done) {
+				return float(loads.finished) / float(loads.added); //(gl stages must run in order)
+			}
+			if (fn.cpu_error) std::rethrow_exception(fn.cpu_error);
+			if (fn.gl) fn.gl(); //call first function in the list
 			fn_list.pop_front(); //remove from list
+			loads.finished += 1;
+
+			auto after = std::chrono::high_resolution_clock::now();
+			if (std::chrono::duration< float >(after - before).count() >= budget) {
+				return float(loads.finished) / float(loads.added);
+			}
 		}
 	}
+	{ //everything is loaded, so workers are exiting (or have exited):
+		std::unique_lock< std::mutex > lock(loads.mutex);
+		loads.join_idle_workers();
+	}
+	return 1.0f;
+}
+
+bool load_functions_finished(LoadTag tag) {
+	Loads &loads = get_loads();
+	assert(tag < loads.lists.size());
+	for (uint32_t t = 0; t <= tag; ++t) {
+		if (!loads.lists[t].empty()) return false;
+	}
+	return true;
 }
@@ -21,9 +21,24 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. "Meshes"] before looking up individual elements within them.)
  *
+ * A Load< T > can also be constructed from the name of a file in the data directory:
+ *
+ * Load< MeshBuffer > menu_meshes(LoadTagInit, "menu.p");
+ *
+ * Such loads go through the AssetRegistry (see AssetRegistry.hpp), so every Load< T > of the same file shares one copy.
+ *
+ * Loading can happen in the background: a load may be split into a CPU stage (e.g. reading and parsing a file),
+ * which runs on a worker thread, and a GL stage (e.g. creating buffers), which runs on the main thread.
+ * Loads from data files are split this way; loads from functions run entirely on the main thread (they may use OpenGL).
+ * GL stages always run in tag order (and, within a tag, in the order loads were added), so they can use earlier loads.
+ *
  */
 
+#include "AssetRegistry.hpp"
+#include "data_path.hpp"
+
 #include <functional>
+#include <memory>
 #include <stdexcept>
 
 enum LoadTag : uint32_t {
@@ -34,7 +49,20 @@ enum LoadTag : uint32_t {
 };
 
 void add_load_function(LoadTag tag, std::function< void() > const &fn);
-void call_load_functions(); //called by main() after GL context created.
+//cpu_fn may run on a worker thread (so must not use OpenGL or the values of other loads); gl_fn runs on the main thread after it:
+void add_load_function(LoadTag tag, std::function< void() > const &cpu_fn, std::function< void() > const &gl_fn);
+void call_load_functions(); //called by main() after GL context created; returns once everything is loaded.
+
+//Background loading (instead of call_load_functions):
+// start_load_functions() starts the CPU stages of all loads on worker threads;
+// update_load_functions(budget) then runs GL stages on the calling (main) thread until about 'budget' seconds have passed,
+// and returns the fraction of loads that are finished (1.0f once everything is loaded).
+// Loads added after start_load_functions() (e.g. level assets) are started right away and finished by later updates
+// (main's game loop calls update_load_functions() once per frame, so a Load<> added during play becomes ready a few frames later).
+void start_load_functions();
+float update_load_functions(float budget);
+//true once every load with a tag up to 'tag' is finished:
+bool load_functions_finished(LoadTag tag);
 
 template< typename T >
 struct Load {
@@ -48,11 +76,23 @@ struct Load {
 		});
 	}
 
+	//Constructing a Load< T > from a data file name acquires the (shared) asset loaded from that file:
+	Load( LoadTag tag, char const *data_file ) : value(nullptr) {
+		std::string name = data_file;
+		add_load_function(tag, [this,name](){
+			this->shared = asset_registry.acquire< T >(data_path(name));
+		}, [this](){
+			upload_asset(*this->shared);
+			this->value = this->shared.get();
+		});
+	}
+
 	//Make a "Load< T >" behave like a "T const *":
 	explicit operator bool() { return value != nullptr; }
 	T const &operator*() { return *value; }
 	T const *operator->() { return value; }
 
 	T const *value;
+	std::shared_ptr< T > shared; //reference held on registry assets (see above)
 };
 
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+//"MappedFile" maps a whole file read-only into memory:
+// the OS pages the contents in on demand (and can drop them again under memory pressure),
+// so nothing is read or copied up front. Use ChunkFile (see ChunkFile.hpp) to look up chunks in a mapped file.
+// note: will throw if the file can't be opened or mapped.
+struct MappedFile {
+	MappedFile(std::string const &filename);
+	~MappedFile();
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	char const *begin() const { return data; }
+	char const *end() const { return data + size; }
+
+	char const *data = nullptr; //(nullptr for empty files)
+	size_t size = 0;
+
+	//internals:
+	#if defined(_WIN32)
+	void *file = nullptr; //HANDLE
+	void *mapping = nullptr; //HANDLE
+	#else
+	int fd = -1;
+	#endif
+};
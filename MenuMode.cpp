@@ -1,8 +1,10 @@
 #include "MenuMode.hpp"
 
 #include "Load.hpp"
+#include "draw_text.hpp"
 #include "compile_program.hpp"
 #include "MeshBuffer.hpp"
+#include "MeshResidency.hpp"
 #include "data_path.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
@@ -10,11 +12,6 @@
 #include <iostream>
 
 //---------- resources ------------
-Load< MeshBuffer > menu_meshes(LoadTagInit, [](){
-	return new MeshBuffer(data_path("menu.p"));
-});
-
-
 //Uniform locations in menu_program:
 GLint menu_program_mvp = -1;
 GLint menu_program_color = -1;
@@ -42,9 +39,9 @@ Load< GLuint > menu_program(LoadTagInit, [](){
 	return ret;
 });
 
-//Binding for using menu_program on menu_meshes:
+//Binding for using menu_program on text_meshes:
 Load< GLuint > menu_binding(LoadTagDefault, [](){
-	return new GLuint(menu_meshes->make_vao_for_program(*menu_program));
+	return new GLuint(text_meshes->vao_for_program(*menu_program));
 });
 
 GLint fade_program_color = -1;
@@ -112,23 +109,20 @@ void MenuMode::update(float elapsed) {
 	}
 }
 
-void MenuMode::draw(glm::uvec2 const &drawable_size) {
-	if (background && background_fade < 1.0f) {
-		background->draw(drawable_size);
-
-		glDisable(GL_DEPTH_TEST);
-		if (background_fade > 0.0f) {
-			glEnable(GL_BLEND);
-			glBlendEquation(GL_FUNC_ADD);
-			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-			glUseProgram(*fade_program);
-			glUniform4fv(fade_program_color, 1, glm::value_ptr(glm::vec4(0.0f, 0.0f, 0.0f, background_fade)));
-			glDrawArrays(GL_TRIANGLES, 0, 3);
-			glUseProgram(0);
-			glDisable(GL_BLEND);
-		}
-	}
+//draws the menu over whatever is already on screen, darkening it by 'fade':
+// (shared by draw and by the snapshots returned from extract)
+static void draw_menu(std::vector< MenuMode::Choice > const &choices, uint32_t selected, float bounce, float fade, glm::uvec2 const &drawable_size) {
 	glDisable(GL_DEPTH_TEST);
+	if (fade > 0.0f) {
+		glEnable(GL_BLEND);
+		glBlendEquation(GL_FUNC_ADD);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glUseProgram(*fade_program);
+		glUniform4fv(fade_program_color, 1, glm::value_ptr(glm::vec4(0.0f, 0.0f, 0.0f, fade)));
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glUseProgram(0);
+		glDisable(GL_BLEND);
+	}
 
 	float aspect = drawable_size.x / float(drawable_size.y);
 	//scale factors such that a rectangle of aspect 'aspect' and height '1.0' fills the window:
@@ -145,6 +139,7 @@ void MenuMode::draw(glm::uvec2 const &drawable_size) {
 		total_height += choice.height + 2.0f * choice.padding;
 	}
 
+	mesh_residency.use(*text_meshes);
 	glUseProgram(*menu_program);
 	glBindVertexArray(*menu_binding);
 
@@ -201,8 +196,12 @@ void MenuMode::draw(glm::uvec2 const &drawable_size) {
 				glUniformMatrix4fv(menu_program_mvp, 1, GL_FALSE, glm::value_ptr(mvp));
 				glUniform3f(menu_program_color, 1.0f, 1.0f, 1.0f);
 
-				MeshBuffer::Mesh const &mesh = menu_meshes->lookup(label.substr(i,1));
-				glDrawArrays(GL_TRIANGLES, mesh.start, mesh.count);
+				MeshBuffer::ID glyph = (*text_glyphs)[uint8_t(label[i])];
+				if (!glyph) {
+					throw std::runtime_error("Drawing character '" + label.substr(i,1) + "' that has no mesh.");
+				}
+				MeshBuffer::Mesh const &mesh = text_meshes->lookup(glyph);
+				glDrawElements(GL_TRIANGLES, mesh.count, text_meshes->index_type, text_meshes->index_offset(mesh.start));
 			}
 
 			x += width(label[i]);
@@ -213,3 +212,30 @@ void MenuMode::draw(glm::uvec2 const &drawable_size) {
 
 	glEnable(GL_DEPTH_TEST);
 }
+
+void MenuMode::draw(glm::uvec2 const &drawable_size) {
+	float fade = 0.0f;
+	if (background && background_fade < 1.0f) {
+		background->draw(drawable_size);
+		fade = background_fade;
+	}
+	draw_menu(choices, selected, bounce, fade, drawable_size);
+}
+
+Mode::RenderFunction MenuMode::extract() {
+	RenderFunction draw_background;
+	float fade = 0.0f;
+	if (background && background_fade < 1.0f) {
+		draw_background = background->extract();
+		//background can't be snapshotted, so neither can the menu:
+		if (!draw_background) return nullptr;
+		fade = background_fade;
+	}
+	std::vector< Choice > choices_copy = choices;
+	uint32_t selected_copy = selected;
+	float bounce_copy = bounce;
+	return [draw_background, choices_copy, selected_copy, bounce_copy, fade](glm::uvec2 const &drawable_size) {
+		if (draw_background) draw_background(drawable_size);
+		draw_menu(choices_copy, selected_copy, bounce_copy, fade, drawable_size);
+	};
+}
@@ -12,6 +12,7 @@ struct MenuMode : public Mode {
 	virtual bool handle_event(SDL_Event const &event, glm::uvec2 const &window_size) override;
 	virtual void update(float elapsed) override;
 	virtual void draw(glm::uvec2 const &drawable_size) override;
+	virtual RenderFunction extract() override;
 
 	struct Choice {
 		Choice(std::string const &label_, std::function< void() > on_select_ = nullptr) : label(label_), on_select(on_select_) { }
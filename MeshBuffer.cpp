@@ -1,38 +1,162 @@
 #include "MeshBuffer.hpp"
-#include "read_chunk.hpp"
+#include "ChunkFile.hpp"
+#include "VertexCodec.hpp"
+#include "MeshResidency.hpp"
 
 #include <glm/glm.hpp>
 
 #include <stdexcept>
-#include <fstream>
+#include <chrono>
+#include <memory>
 #include <iostream>
+#include <sstream>
 #include <vector>
 #include <string>
 #include <set>
+#include <unordered_map>
+#include <cassert>
+#include <cmath>
+#include <cstring>
 #include <cstddef>
+#include <algorithm>
+
+//Reorder the triangles in indices[0,count) so that recently-used vertices are reused while they are still
+// in the GPU's post-transform cache (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"):
+static void optimize_vertex_cache(uint32_t *indices, uint32_t count) {
+	static const int32_t CacheSize = 32;
+	uint32_t triangles = count / 3;
+	if (triangles < 2) return;
+
+	//local vertex numbering for this range:
+	std::unordered_map< uint32_t, uint32_t > local_of;
+	std::vector< uint32_t > local(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		local[i] = local_of.insert(std::make_pair(indices[i], uint32_t(local_of.size()))).first->second;
+	}
+	uint32_t vertices = uint32_t(local_of.size());
+
+	//triangles using each vertex:
+	std::vector< uint32_t > remaining(vertices, 0); //triangles not yet emitted
+	for (uint32_t i = 0; i < count; ++i) remaining[local[i]] += 1;
+	std::vector< uint32_t > adjacency_begin(vertices + 1, 0);
+	for (uint32_t v = 0; v < vertices; ++v) adjacency_begin[v+1] = adjacency_begin[v] + remaining[v];
+	std::vector< uint32_t > adjacency(count);
+	{
+		std::vector< uint32_t > fill(adjacency_begin.begin(), adjacency_begin.end() - 1);
+		for (uint32_t i = 0; i < count; ++i) adjacency[fill[local[i]]++] = i / 3;
+	}
 
-MeshBuffer::MeshBuffer(std::string const &filename) {
-	glGenBuffers(1, &vbo);
+	std::vector< int32_t > cache_position(vertices, -1);
+	auto vertex_score = [&](uint32_t v) -> float {
+		if (remaining[v] == 0) return -1.0f;
+		float score = 0.0f;
+		int32_t position = cache_position[v];
+		if (position >= 0) {
+			//the most recent triangle's vertices get a fixed score, so the next triangle isn't biased toward one of them:
+			if (position < 3) score = 0.75f;
+			else score = std::pow(1.0f - float(position - 3) / float(CacheSize - 3), 1.5f);
+		}
+		//favor vertices with few triangles left, to finish them off:
+		score += 2.0f / std::sqrt(float(remaining[v]));
+		return score;
+	};
+
+	std::vector< float > score(vertices);
+	for (uint32_t v = 0; v < vertices; ++v) score[v] = vertex_score(v);
+	std::vector< float > triangle_score(triangles);
+	std::vector< bool > emitted(triangles, false);
+	for (uint32_t t = 0; t < triangles; ++t) {
+		triangle_score[t] = score[local[3*t+0]] + score[local[3*t+1]] + score[local[3*t+2]];
+	}
+
+	std::vector< uint32_t > cache; //local vertex ids, most recent first
+	std::vector< uint32_t > output;
+	output.reserve(count);
+	uint32_t scan = 0; //lowest triangle that might not have been emitted (for fallback search)
+
+	uint32_t best = 0;
+	for (uint32_t t = 1; t < triangles; ++t) {
+		if (triangle_score[t] > triangle_score[best]) best = t;
+	}
+	while (true) {
+		//emit best triangle:
+		emitted[best] = true;
+		for (uint32_t c = 0; c < 3; ++c) {
+			output.emplace_back(indices[3*best+c]);
+			uint32_t v = local[3*best+c];
+			remaining[v] -= 1;
+			auto f = std::find(cache.begin(), cache.end(), v);
+			if (f != cache.end()) cache.erase(f);
+		}
+		cache.insert(cache.begin(), { local[3*best+0], local[3*best+1], local[3*best+2] });
+
+		//update cache positions (vertices pushed past the end leave the cache):
+		for (uint32_t i = 0; i < cache.size(); ++i) {
+			cache_position[cache[i]] = (int32_t(i) < CacheSize ? int32_t(i) : -1);
+		}
+		for (auto v : cache) score[v] = vertex_score(v);
+
+		//rescore triangles touching the cache and pick the best one:
+		float best_score = -1.0f;
+		for (auto v : cache) {
+			for (uint32_t a = adjacency_begin[v]; a < adjacency_begin[v+1]; ++a) {
+				uint32_t t = adjacency[a];
+				if (emitted[t]) continue;
+				triangle_score[t] = score[local[3*t+0]] + score[local[3*t+1]] + score[local[3*t+2]];
+				if (triangle_score[t] > best_score) {
+					best_score = triangle_score[t];
+					best = t;
+				}
+			}
+		}
+		if (cache.size() > uint32_t(CacheSize)) cache.resize(CacheSize);
+
+		if (best_score < 0.0f) {
+			//nothing in the cache has triangles left; start over from any remaining triangle:
+			while (scan < triangles && emitted[scan]) ++scan;
+			if (scan == triangles) break;
+			best = scan;
+		}
+	}
+	assert(output.size() == count);
+	std::copy(output.begin(), output.end(), indices);
+}
 
-	std::ifstream file(filename, std::ios::binary);
+//average vertex shader runs per triangle when drawing indices with a FIFO post-transform cache:
+static float fifo_acmr(std::vector< uint32_t > const &indices, uint32_t vertices, uint32_t cache_size) {
+	if (indices.size() < 3) return 0.0f;
+	std::vector< uint64_t > entered(vertices, -1ULL); //miss count when vertex entered the cache
+	uint64_t misses = 0;
+	for (auto v : indices) {
+		if (entered[v] == -1ULL || misses - entered[v] >= cache_size) {
+			entered[v] = misses;
+			misses += 1;
+		}
+	}
+	return float(misses) / float(indices.size() / 3);
+}
 
-	GLuint total = 0;
-	//read + upload data chunk:
+MeshBuffer::MeshBuffer(std::string const &filename_) : filename(filename_) {
+	auto before = std::chrono::high_resolution_clock::now();
+
+	//the file is mapped rather than read, so chunks are used in place (without being copied into vectors):
+	ChunkFile file(filename);
+
+	//read vertex data chunk (as triangle soup):
+	char const *soup = nullptr;
+	size_t soup_count = 0;
+	GLsizei stride = 0;
+	std::unique_ptr< char[] > decoded; //holds the soup for compressed files
+	size_t compressed_bytes = 0;
+	double decode_seconds = 0.0;
 	if (filename.size() >= 2 && filename.substr(filename.size()-2) == ".p") {
 		struct Vertex {
 			glm::vec3 Position;
 		};
 		static_assert(sizeof(Vertex) == 3*4, "Vertex is packed.");
 
-		std::vector< Vertex > data;
-		read_chunk(file, "p...", &data);
-
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		total = GLuint(data.size()); //store total for later checks on index
+		file.span< Vertex >("p...", &soup, &soup_count);
+		stride = sizeof(Vertex);
 
 		//store attrib locations:
 		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
@@ -44,15 +168,8 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		};
 		static_assert(sizeof(Vertex) == 3*4+3*4, "Vertex is packed.");
 
-		std::vector< Vertex > data;
-		read_chunk(file, "pn..", &data);
-
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		total = GLuint(data.size()); //store total for later checks on index
+		file.span< Vertex >("pn..", &soup, &soup_count);
+		stride = sizeof(Vertex);
 
 		//store attrib locations:
 		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
@@ -66,15 +183,8 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		};
 		static_assert(sizeof(Vertex) == 3*4+3*4+4*1, "Vertex is packed.");
 
-		std::vector< Vertex > data;
-		read_chunk(file, "pnc.", &data);
-
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		total = GLuint(data.size()); //store total for later checks on index
+		file.span< Vertex >("pnc.", &soup, &soup_count);
+		stride = sizeof(Vertex);
 
 		//store attrib locations:
 		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
@@ -90,15 +200,8 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		};
 		static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
 
-		std::vector< Vertex > data;
-		read_chunk(file, "pnct", &data);
-
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		total = GLuint(data.size()); //store total for later checks on index
+		file.span< Vertex >("pnct", &soup, &soup_count);
+		stride = sizeof(Vertex);
 
 		//store attrib locations:
 		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
@@ -106,12 +209,49 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
 		TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
 
+	} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".qpnc") {
+		//cooked by meshes/cook-meshes.py (positions are relative to each mesh's scale and bias, see 'qsb0' below):
+		struct Vertex {
+			glm::i16vec4 Position; //16-bit normalized xyz (w is padding)
+			uint32_t Normal; //GL_INT_2_10_10_10_REV
+			glm::u8vec4 Color;
+		};
+		static_assert(sizeof(Vertex) == 4*2+4+4*1, "Vertex is packed.");
+
+		stride = sizeof(Vertex);
+		if (file.find("qpnz")) {
+			//compressed vertices (cook-meshes.py --compress): a vertex count, then the vertices as described in VertexCodec.hpp
+			char const *packed = nullptr;
+			size_t packed_size = 0;
+			file.span< char >("qpnz", &packed, &packed_size);
+			uint32_t count = 0;
+			if (packed_size < sizeof(count)) throw std::runtime_error("compressed vertex chunk is missing its vertex count");
+			std::memcpy(&count, packed, sizeof(count));
+			auto decode_before = std::chrono::high_resolution_clock::now();
+			decoded.reset(new char[size_t(count) * stride]);
+			decode_vertices(packed + sizeof(count), packed + packed_size, count, stride, decoded.get());
+			auto decode_after = std::chrono::high_resolution_clock::now();
+			decode_seconds = std::chrono::duration< double >(decode_after - decode_before).count();
+			soup = decoded.get();
+			soup_count = count;
+			compressed_bytes = packed_size;
+		} else {
+			file.span< Vertex >("qpnc", &soup, &soup_count);
+		}
+
+		//store attrib locations:
+		Position = Attrib(3, GL_SHORT, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Position));
+		Normal = Attrib(4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Normal));
+		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
+
 	} else {
 		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
+	bool quantized = (Position.type != GL_FLOAT);
+	GLuint total = GLuint(soup_count); //store total for later checks on index
 
 	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	file.read("str0", &strings);
 
 	{ //read index chunk, add to meshes:
 		struct IndexEntry {
@@ -121,7 +261,22 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
 
 		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+		file.read("idx0", &index);
+
+		//quantized files also store a position scale and bias for each index entry:
+		struct ScaleBiasEntry {
+			glm::vec3 scale;
+			glm::vec3 bias;
+		};
+		static_assert(sizeof(ScaleBiasEntry) == 24, "Scale/bias entry should be packed");
+
+		std::vector< ScaleBiasEntry > scale_bias;
+		if (quantized) {
+			file.read("qsb0", &scale_bias);
+			if (scale_bias.size() != index.size()) {
+				throw std::runtime_error("scale/bias chunk doesn't match index chunk");
+			}
+		}
 
 		for (auto const &entry : index) {
 			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
@@ -134,37 +289,296 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 			Mesh mesh;
 			mesh.start = entry.vertex_begin;
 			mesh.count = entry.vertex_end - entry.vertex_begin;
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-			if (!inserted) {
+			if (quantized) {
+				mesh.position_scale = scale_bias[&entry - &index[0]].scale;
+				mesh.position_bias = scale_bias[&entry - &index[0]].bias;
+			}
+			if (mesh.count) { //bounding sphere around the center of the bounding box:
+				auto position = [&](GLuint i) {
+					return mesh.position_scale * read_position(&soup[i * stride]) + mesh.position_bias;
+				};
+				glm::vec3 min = position(mesh.start);
+				glm::vec3 max = min;
+				for (GLuint i = mesh.start; i < mesh.start + mesh.count; ++i) {
+					min = glm::min(min, position(i));
+					max = glm::max(max, position(i));
+				}
+				mesh.center = 0.5f * (min + max);
+				for (GLuint i = mesh.start; i < mesh.start + mesh.count; ++i) {
+					mesh.radius = std::max(mesh.radius, glm::length(position(i) - mesh.center));
+				}
+			}
+			bool inserted = ids.insert(std::make_pair(name, uint32_t(meshes.size()))).second;
+			if (inserted) {
+				meshes.emplace_back(mesh);
+			} else {
 				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
 			}
 		}
 	}
 
-	if (file.peek() != EOF) {
-		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
+	//weld identical vertices:
+	// (index i refers to the welded copy of soup vertex i, so mesh start/count are unchanged as index ranges)
+	std::vector< uint32_t > indices(total);
+	uint32_t welded_count = 0;
+	{
+		//vertices are keyed by their index in the soup, but hashed and compared by their bytes:
+		auto hash = [soup,stride](uint32_t i) {
+			uint32_t h = 2166136261U; //FNV-1a
+			for (char const *c = soup + size_t(i) * stride; c != soup + size_t(i + 1) * stride; ++c) {
+				h = (h ^ uint8_t(*c)) * 16777619U;
+			}
+			return size_t(h);
+		};
+		auto equal = [soup,stride](uint32_t a, uint32_t b) {
+			return std::memcmp(soup + size_t(a) * stride, soup + size_t(b) * stride, stride) == 0;
+		};
+		std::unordered_map< uint32_t, uint32_t, decltype(hash), decltype(equal) > welded(total, hash, equal);
+		for (GLuint i = 0; i < total; ++i) {
+			indices[i] = welded.insert(std::make_pair(i, uint32_t(welded.size()))).first->second;
+		}
+		welded_count = uint32_t(welded.size());
+	}
+	std::vector< uint32_t > soup_of(welded_count); //a soup vertex for each welded vertex
+	for (GLuint i = 0; i < total; ++i) soup_of[indices[i]] = i;
+
+	//reorder each mesh's triangles for the post-transform cache:
+	// (ranges shared or overlapped by several meshes are left alone)
+	{
+		std::vector< std::pair< GLuint, GLuint > > ranges;
+		for (auto const &m : meshes) {
+			ranges.emplace_back(m.start, m.start + m.count);
+		}
+		std::sort(ranges.begin(), ranges.end());
+		for (uint32_t r = 0; r < ranges.size(); ++r) {
+			bool overlaps = (r > 0 && ranges[r-1].second > ranges[r].first)
+			             || (r + 1 < ranges.size() && ranges[r+1].first < ranges[r].second);
+			if (overlaps || (ranges[r].second - ranges[r].first) % 3 != 0) continue;
+			optimize_vertex_cache(indices.data() + ranges[r].first, ranges[r].second - ranges[r].first);
+		}
+	}
+
+	//renumber vertices in order of first use (so vertex fetches also walk memory in order):
+	//(not a std::vector, which would zero-fill memory that is about to be overwritten)
+	size_t vertex_bytes = size_t(welded_count) * stride;
+	std::unique_ptr< char[] > vertices(new char[vertex_bytes]);
+	{
+		std::vector< uint32_t > renumber(welded_count, -1U);
+		uint32_t next = 0;
+		for (auto &index : indices) {
+			if (renumber[index] == -1U) {
+				renumber[index] = next;
+				std::memcpy(&vertices[size_t(next) * stride], &soup[size_t(soup_of[index]) * stride], stride);
+				next += 1;
+			}
+			index = renumber[index];
+		}
+		assert(next == welded_count);
 	}
 
+	//keep data for upload() (which needs the OpenGL context, so may run later and on another thread):
+	pending_vertices = std::move(vertices);
+	vbo_bytes = vertex_bytes;
+
+	size_t index_bytes = 0;
+	if (welded_count <= 0x10000) {
+		index_type = GL_UNSIGNED_SHORT;
+		std::vector< uint16_t > short_indices(indices.begin(), indices.end());
+		index_bytes = short_indices.size() * sizeof(uint16_t);
+		pending_indices.assign(reinterpret_cast< char const * >(short_indices.data()), reinterpret_cast< char const * >(short_indices.data()) + index_bytes);
+	} else {
+		index_type = GL_UNSIGNED_INT;
+		index_bytes = indices.size() * sizeof(uint32_t);
+		pending_indices.assign(reinterpret_cast< char const * >(indices.data()), reinterpret_cast< char const * >(indices.data()) + index_bytes);
+	}
+	ibo_bytes = index_bytes;
+
+	auto after = std::chrono::high_resolution_clock::now();
+	std::ostringstream decode_note;
+	if (decoded) {
+		decode_note << "decompressed " << compressed_bytes << " -> " << soup_count * stride << " bytes at "
+			<< (soup_count * stride) / std::max(decode_seconds, 1e-9) / 1e6 << " MB/s, ";
+	}
+	std::cout << "MeshBuffer '" << filename << "': " << total << " -> " << welded_count << " vertices, "
+		<< soup_count * stride << " -> " << vertex_bytes << " + " << index_bytes << " (index) bytes, "
+		<< "vertex shader runs per triangle 3.00 -> " << fifo_acmr(indices, welded_count, 16) << " (16-entry FIFO cache), "
+		<< decode_note.str() << "loaded in " << std::chrono::duration< double, std::milli >(after - before).count() << " ms." << std::endl;
+
 	/* //DEBUG:
 	std::cout << "File '" << filename << "' contained meshes";
-	for (auto const &m : meshes) {
-		if (&m.second == &meshes.rbegin()->second && meshes.size() > 1) std::cout << " and";
+	for (auto const &m : ids) {
+		if (&m.second == &ids.rbegin()->second && ids.size() > 1) std::cout << " and";
 		std::cout << " '" << m.first << "'";
-		if (&m.second != &meshes.rbegin()->second) std::cout << ",";
+		if (&m.second != &ids.rbegin()->second) std::cout << ",";
 	}
 	std::cout << std::endl;
 	*/
 }
 
+void MeshBuffer::upload() {
+	if (vbo != 0) return; //already uploaded
+
+	glGenBuffers(1, &vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, vbo_bytes, pending_vertices.get(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glGenBuffers(1, &ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, ibo_bytes, pending_indices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	pending_vertices.reset();
+	pending_indices.clear();
+	pending_indices.shrink_to_fit();
+
+	mesh_residency.add(*this);
+}
+
+MeshBuffer::~MeshBuffer() {
+	//(OpenGL objects aren't freed here, since buffers may outlive the OpenGL context)
+	mesh_residency.remove(*this);
+}
+
 const MeshBuffer::Mesh &MeshBuffer::lookup(std::string const &name) const {
-	auto f = meshes.find(name);
-	if (f == meshes.end()) {
+	return lookup(id(name));
+}
+
+MeshBuffer::ID MeshBuffer::id(std::string const &name) const {
+	ID ret = find_id(name);
+	if (!ret) {
 		throw std::runtime_error("Looking up mesh '" + name + "' that doesn't exist.");
 	}
-	return f->second;
+	return ret;
+}
+
+MeshBuffer::ID MeshBuffer::find_id(std::string const &name) const {
+	ID ret;
+	auto f = ids.find(name);
+	if (f != ids.end()) ret.index = f->second;
+	return ret;
+}
+
+std::vector< MeshBuffer::Mesh > MeshBuffer::lookup_lods(std::string const &name) const {
+	std::vector< Mesh > lods;
+	lods.emplace_back(lookup(name));
+	while (true) {
+		ID lod = find_id(name + ".LOD" + std::to_string(lods.size()));
+		if (!lod) break;
+		lods.emplace_back(lookup(lod));
+	}
+	return lods;
+}
+
+glm::vec3 MeshBuffer::read_position(char const *vertex) const {
+	vertex += Position.offset;
+	if (Position.type == GL_SHORT) {
+		glm::i16vec3 stored;
+		std::memcpy(&stored, vertex, sizeof(stored));
+		return glm::max(glm::vec3(stored) / 32767.0f, glm::vec3(-1.0f));
+	} else {
+		assert(Position.type == GL_FLOAT);
+		glm::vec3 stored;
+		std::memcpy(&stored, vertex, sizeof(stored));
+		return stored;
+	}
+}
+
+void MeshBuffer::write_position(char *vertex, glm::vec3 const &position) const {
+	vertex += Position.offset;
+	if (Position.type == GL_SHORT) {
+		glm::i16vec3 stored = glm::i16vec3(glm::round(glm::clamp(position, glm::vec3(-1.0f), glm::vec3(1.0f)) * 32767.0f));
+		std::memcpy(vertex, &stored, sizeof(stored));
+	} else {
+		assert(Position.type == GL_FLOAT);
+		std::memcpy(vertex, &position, sizeof(position));
+	}
+}
+
+glm::vec3 MeshBuffer::read_normal(char const *vertex) const {
+	vertex += Normal.offset;
+	if (Normal.type == GL_INT_2_10_10_10_REV) {
+		uint32_t bits;
+		std::memcpy(&bits, vertex, sizeof(bits));
+		glm::vec3 ret;
+		for (uint32_t c = 0; c < 3; ++c) {
+			int32_t v = int32_t((bits >> (10 * c)) & 0x3ff);
+			if (v & 0x200) v -= 0x400; //sign extend
+			ret[c] = std::max(float(v) / 511.0f, -1.0f);
+		}
+		return ret;
+	} else {
+		assert(Normal.type == GL_FLOAT);
+		glm::vec3 ret;
+		std::memcpy(&ret, vertex, sizeof(ret));
+		return ret;
+	}
+}
+
+void MeshBuffer::write_normal(char *vertex, glm::vec3 const &normal) const {
+	vertex += Normal.offset;
+	if (Normal.type == GL_INT_2_10_10_10_REV) {
+		uint32_t bits = 0;
+		for (uint32_t c = 0; c < 3; ++c) {
+			int32_t v = int32_t(std::round(glm::clamp(normal[c], -1.0f, 1.0f) * 511.0f));
+			bits |= (uint32_t(v) & 0x3ff) << (10 * c);
+		}
+		std::memcpy(vertex, &bits, sizeof(bits));
+	} else {
+		assert(Normal.type == GL_FLOAT);
+		std::memcpy(vertex, &normal, sizeof(normal));
+	}
+}
+
+//Program introspection (glGetAttribLocation, glGetActiveAttrib) is a synchronous round trip to the driver,
+// so each program's attribute locations are queried once and cached:
+namespace {
+	struct ProgramAttributes {
+		std::unordered_map< std::string, GLint > locations; //active attributes (name -> location)
+		GLint location(char const *name) const {
+			auto f = locations.find(name);
+			return (f == locations.end() ? -1 : f->second);
+		}
+	};
+}
+
+static ProgramAttributes const &program_attributes(GLuint program) {
+	//(programs are never deleted, so program names aren't reused)
+	static std::unordered_map< GLuint, ProgramAttributes > cache;
+	auto f = cache.find(program);
+	if (f != cache.end()) return f->second;
+
+	ProgramAttributes &attributes = cache[program];
+	GLint active = 0;
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &active);
+	assert(active >= 0 && "Doesn't makes sense to have negative active attributes.");
+	for (GLuint i = 0; i < GLuint(active); ++i) {
+		GLchar name[100];
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveAttrib(program, i, 100, NULL, &size, &type, name);
+		name[99] = '\0';
+		attributes.locations[name] = glGetAttribLocation(program, name);
+	}
+	return attributes;
+}
+
+GLuint MeshBuffer::vao_for_program(GLuint program) const {
+	auto f = vaos.find(program);
+	if (f != vaos.end()) return f->second;
+	GLuint vao = make_vao_for_program(program);
+	vaos.insert(std::make_pair(program, vao));
+	return vao;
 }
 
 GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
+	assert(vbo != 0 && "MeshBuffer must be uploaded before making a vao for it.");
+	return make_vao_for_program(program, vbo, ibo);
+}
+
+GLuint MeshBuffer::make_vao_for_program(GLuint program, GLuint vbo, GLuint ibo) const {
+	ProgramAttributes const &attributes = program_attributes(program);
+
 	//create a new vertex array object:
 	GLuint vao = 0;
 	glGenVertexArrays(1, &vao);
@@ -175,7 +589,7 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
 	auto bind_attribute = [&](char const *name, MeshBuffer::Attrib const &attrib) {
 		if (attrib.size == 0) return; //don't bind empty attribs
-		GLint location = glGetAttribLocation(program, name);
+		GLint location = attributes.location(name);
 		if (location == -1) {
 			std::cerr << "WARNING: attribute '" << name << "' in mesh buffer isn't active in program." << std::endl;
 		} else {
@@ -189,21 +603,14 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 	bind_attribute("Color", Color);
 	bind_attribute("TexCoord", TexCoord);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//element buffer binding is part of the vao's state:
+	if (ibo) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
 	glBindVertexArray(0);
 
 	//Check that all active attributes were bound:
-	GLint active = 0;
-	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &active);
-	assert(active >= 0 && "Doesn't makes sense to have negative active attributes.");
-	for (GLuint i = 0; i < GLuint(active); ++i) {
-		GLchar name[100];
-		GLint size = 0;
-		GLenum type = 0;
-		glGetActiveAttrib(program, i, 100, NULL, &size, &type, name);
-		name[99] = '\0';
-		GLint location = glGetAttribLocation(program, name);
-		if (!bound.count(GLuint(location))) {
-			throw std::runtime_error("ERROR: active attribute '" + std::string(name) + "' in program is not bound.");
+	for (auto const &active : attributes.locations) {
+		if (!bound.count(GLuint(active.second))) {
+			throw std::runtime_error("ERROR: active attribute '" + active.first + "' in program is not bound.");
 		}
 	}
 
@@ -1,13 +1,26 @@
 #pragma once
 
 #include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cassert>
 #include <map>
+#include <memory>
+#include <string>
+#include <vector>
 
 //"MeshBuffer" holds a collection of meshes loaded from a file
 // (note that meshes in a single collection will share a vbo/vao)
 
 struct MeshBuffer {
 	GLuint vbo = 0; //OpenGL vertex buffer object containing the meshes' data
+	GLuint ibo = 0; //OpenGL element buffer object: meshes are drawn as indexed triangles (see Mesh)
+	GLenum index_type = GL_UNSIGNED_SHORT; //type of ibo's indices (GL_UNSIGNED_SHORT or GL_UNSIGNED_INT)
+	size_t vbo_bytes = 0, ibo_bytes = 0; //sizes of vbo and ibo
+
+	//memory used by this buffer's OpenGL objects (see AssetRegistry):
+	size_t bytes() const { return vbo_bytes + ibo_bytes; }
 
 	//Attrib includes location within the vertex buffer of various attributes:
 	// (exactly the parameters to glVertexAttribPointer)
@@ -30,22 +43,102 @@ struct MeshBuffer {
 
 
 	//construct from a file:
+	// '.p', '.pn', '.pnc', '.pnct' files are written by meshes/export-meshes.py;
+	// '.qpnc' files are cooked from '.pnc' files by meshes/cook-meshes.py and use a compact vertex
+	// (16-bit normalized positions with a per-mesh scale and bias, 2_10_10_10 normals; 16 bytes instead of 28),
+	// and may have their vertices compressed (see VertexCodec.hpp), in which case they are decoded at load time.
+	// identical vertices are welded, an index buffer is built, and each mesh's triangles are
+	// reordered so that vertices are reused from the post-transform cache.
 	// note: will throw if file fails to read.
+	// note: doesn't use OpenGL (so may run on a worker thread); call upload() before drawing.
 	MeshBuffer(std::string const &filename);
+	~MeshBuffer();
+
+	//create vbo and ibo from the loaded data (on the thread with the OpenGL context; does nothing if already uploaded):
+	// (uploaded buffers are managed by mesh_residency, which may evict and reload them; see MeshResidency.hpp)
+	void upload();
 
 	//look up a particular mesh in the DB:
 	// note: will throw if mesh not found.
 	struct Mesh {
+		//range of indices in ibo, e.g. glDrawElements(GL_TRIANGLES, count, index_type, index_offset(start)):
 		GLuint start = 0;
 		GLuint count = 0;
+		//stored positions are decoded as position_scale * Position + position_bias
+		// (not the identity only for quantized formats; Scene::Object has matching fields):
+		glm::vec3 position_scale = glm::vec3(1.0f);
+		glm::vec3 position_bias = glm::vec3(0.0f);
+		//bounding sphere (in mesh coordinates):
+		glm::vec3 center = glm::vec3(0.0f);
+		float radius = 0.0f;
 	};
 	const Mesh &lookup(std::string const &name) const;
+
+	//meshes can also be looked up by ID, which indexes a flat array:
+	// (resolve names to IDs once, e.g. at load time, instead of searching for names every frame)
+	struct ID {
+		uint32_t index = -1U;
+		explicit operator bool() const { return index != -1U; }
+	};
+	//note: will throw if mesh not found.
+	ID id(std::string const &name) const;
+	//returns ID() (which converts to false) if mesh not found:
+	ID find_id(std::string const &name) const;
+	const Mesh &lookup(ID id) const {
+		assert(id.index < meshes.size() && "ID must come from this MeshBuffer.");
+		return meshes[id.index];
+	}
+
+	//look up a mesh and its level-of-detail chain:
+	// meshes named "Name.LOD1", "Name.LOD2", ... are successively coarser versions of "Name".
+	// returns { Name, Name.LOD1, ... } (just { Name } if there are no LOD meshes)
+	// note: will throw if "Name" is not found.
+	std::vector< Mesh > lookup_lods(std::string const &name) const;
 	
-	//build a vertex array object that links this vbo to attributes to a program:
+	//byte offset of an index in ibo (for glDrawElements):
+	GLvoid const *index_offset(GLuint start) const {
+		return (GLbyte const *)0 + start * (index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+	}
+
+	//read/write the position or normal of a vertex stored in this buffer's layout:
+	// (positions are in stored units, i.e. before position_scale/position_bias are applied)
+	glm::vec3 read_position(char const *vertex) const;
+	void write_position(char *vertex, glm::vec3 const &position) const;
+	glm::vec3 read_normal(char const *vertex) const;
+	void write_normal(char *vertex, glm::vec3 const &normal) const;
+
+	//get a vertex array object that links this vbo to attributes to a program:
+	// (made by make_vao_for_program the first time; later calls with the same program return the same vao)
+	GLuint vao_for_program(GLuint program) const;
+
+	//build a new vertex array object that links this vbo to attributes to a program:
 	//  will throw if program defines attributes not contained in this buffer
 	//  and warn if this buffer contains attributes not active in the program
+	// (programs' attribute locations are looked up once and cached)
 	GLuint make_vao_for_program(GLuint program) const;
 
+	//as above, but for a different buffer with the same layout as this one (e.g. a baked copy):
+	// (the vao uses element buffer 'ibo', if given)
+	GLuint make_vao_for_program(GLuint program, GLuint vbo, GLuint ibo = 0) const;
+
 	//internals:
-	std::map< std::string, Mesh > meshes;
+	std::string filename; //file the buffer was loaded from
+	struct Residency {
+		bool resident = false; //vbo and ibo hold their data
+		uint64_t last_used = 0; //frame in which the buffer was last used (see MeshResidency::frame)
+		MeshBuffer const *newer = nullptr; //neighbors in mesh_residency's most-recently-drawn list
+		MeshBuffer const *older = nullptr;
+		std::vector< char > vertices, indices; //vbo/ibo contents while evicted (read back by MeshResidency::evict)
+	};
+	mutable Residency residency; //(managed by mesh_residency)
+	std::vector< Mesh > meshes; //indexed by ID
+	std::map< std::string, uint32_t > ids; //name -> index in meshes
+	std::unique_ptr< char[] > pending_vertices; //vbo data waiting for upload()
+	std::vector< char > pending_indices; //ibo data waiting for upload()
+	mutable std::map< GLuint, GLuint > vaos; //program -> vao (see vao_for_program)
 };
+
+//MeshBuffers loaded through the AssetRegistry are uploaded by Load< MeshBuffer > (see Load.hpp):
+inline void upload_asset(MeshBuffer &buffer) {
+	buffer.upload();
+}
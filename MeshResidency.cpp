@@ -0,0 +1,111 @@
+#include "MeshResidency.hpp"
+
+#include "MeshBuffer.hpp"
+
+#include <chrono>
+
+MeshResidency mesh_residency;
+
+void MeshResidency::link(MeshBuffer const &buffer) {
+	assert(!buffer.residency.resident);
+	buffer.residency.resident = true;
+	buffer.residency.newer = nullptr;
+	buffer.residency.older = newest;
+	if (newest) newest->residency.newer = &buffer;
+	else oldest = &buffer;
+	newest = &buffer;
+	stats.resident_bytes += buffer.bytes();
+	stats.resident_buffers += 1;
+}
+
+void MeshResidency::unlink(MeshBuffer const &buffer) {
+	assert(buffer.residency.resident);
+	buffer.residency.resident = false;
+	if (buffer.residency.newer) buffer.residency.newer->residency.older = buffer.residency.older;
+	else newest = buffer.residency.older;
+	if (buffer.residency.older) buffer.residency.older->residency.newer = buffer.residency.newer;
+	else oldest = buffer.residency.newer;
+	buffer.residency.newer = buffer.residency.older = nullptr;
+	stats.resident_bytes -= buffer.bytes();
+	stats.resident_buffers -= 1;
+}
+
+void MeshResidency::add(MeshBuffer const &buffer) {
+	link(buffer);
+	buffer.residency.last_used = frame;
+}
+
+void MeshResidency::remove(MeshBuffer const &buffer) {
+	if (buffer.residency.resident) unlink(buffer);
+}
+
+void MeshResidency::use(MeshBuffer const &buffer) {
+	if (buffer.vbo == 0) return; //not uploaded yet (so not managed)
+	if (!buffer.residency.resident) {
+		auto before = std::chrono::high_resolution_clock::now();
+		reload(buffer);
+		auto after = std::chrono::high_resolution_clock::now();
+		stats.reload_stalls += 1;
+		stats.reload_stall_seconds += std::chrono::duration< double >(after - before).count();
+	} else if (newest != &buffer) {
+		//move to front of list:
+		unlink(buffer);
+		link(buffer);
+	}
+	buffer.residency.last_used = frame;
+}
+
+void MeshResidency::end_frame() {
+	while (stats.resident_bytes > budget && oldest && oldest->residency.last_used < frame) {
+		evict(*oldest);
+	}
+	frame += 1;
+}
+
+void MeshResidency::evict(MeshBuffer const &buffer) {
+	if (!buffer.residency.resident) return;
+	unlink(buffer);
+
+	//keep the (already cooked) contents so reload() only has to upload them again:
+	// (GL_COPY_WRITE_BUFFER is used because binding GL_ELEMENT_ARRAY_BUFFER would change the bound vao)
+	buffer.residency.vertices.resize(buffer.vbo_bytes);
+	buffer.residency.indices.resize(buffer.ibo_bytes);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.vbo);
+	glGetBufferSubData(GL_COPY_WRITE_BUFFER, 0, buffer.vbo_bytes, buffer.residency.vertices.data());
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.ibo);
+	glGetBufferSubData(GL_COPY_WRITE_BUFFER, 0, buffer.ibo_bytes, buffer.residency.indices.data());
+
+	//free storage but keep the buffer names (and so any vaos that refer to them):
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.vbo);
+	glBufferData(GL_COPY_WRITE_BUFFER, 0, nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.ibo);
+	glBufferData(GL_COPY_WRITE_BUFFER, 0, nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	stats.evictions += 1;
+}
+
+void MeshResidency::reload(MeshBuffer const &buffer) {
+	if (buffer.residency.resident) return;
+	assert(buffer.residency.vertices.size() == buffer.vbo_bytes && buffer.residency.indices.size() == buffer.ibo_bytes);
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.vbo);
+	glBufferData(GL_COPY_WRITE_BUFFER, buffer.vbo_bytes, buffer.residency.vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.ibo);
+	glBufferData(GL_COPY_WRITE_BUFFER, buffer.ibo_bytes, buffer.residency.indices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	buffer.residency.vertices.clear();
+	buffer.residency.vertices.shrink_to_fit();
+	buffer.residency.indices.clear();
+	buffer.residency.indices.shrink_to_fit();
+
+	link(buffer);
+}
+
+void MeshResidency::report(std::ostream &out) const {
+	out << "Mesh residency: " << stats.resident_bytes << " bytes in " << stats.resident_buffers << " buffer(s) resident";
+	if (budget != std::numeric_limits< size_t >::max()) out << " (budget " << budget << ")";
+	out << "; " << stats.evictions << " eviction(s), " << stats.reload_stalls << " reload stall(s) taking "
+		<< stats.reload_stall_seconds * 1000.0 << " ms." << std::endl;
+}
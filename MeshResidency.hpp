@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+
+struct MeshBuffer;
+
+//"MeshResidency" bounds the GPU memory used by MeshBuffers:
+// every uploaded MeshBuffer is tracked in a most-recently-drawn list; at the end of each frame, the least recently
+// drawn buffers are evicted (their vbo/ibo storage is freed) until the resident ones fit in 'budget'.
+// An evicted buffer keeps its vbo/ibo names (so vaos made for it, e.g. in Scene::Object::vao, stay valid)
+// and a CPU copy of its contents; it is uploaded again the next time it is used, which stalls the frame that uses it.
+//
+//Usage:
+//  mesh_residency.use(*meshes); //before drawing from a MeshBuffer (Scene::draw_items does this for items with a mesh_buffer)
+//  ...
+//  mesh_residency.end_frame(); //after drawing a frame (main does this)
+//
+//All functions use OpenGL, so must be called on the thread with the OpenGL context.
+
+struct MeshResidency {
+	//bytes of vbo + ibo storage to keep resident (buffers used in the current frame are never evicted, so this can be exceeded):
+	size_t budget = std::numeric_limits< size_t >::max();
+
+	//called by MeshBuffer::upload() and ~MeshBuffer():
+	void add(MeshBuffer const &buffer);
+	void remove(MeshBuffer const &buffer);
+
+	//mark a buffer as drawn this frame (reloading it if it was evicted):
+	void use(MeshBuffer const &buffer);
+
+	//evict least recently drawn buffers until under budget, then start the next frame:
+	void end_frame();
+
+	//free a buffer's vbo/ibo storage now (e.g. when leaving a level; its contents are read back first) / upload it again:
+	void evict(MeshBuffer const &buffer);
+	void reload(MeshBuffer const &buffer);
+
+	struct Stats {
+		size_t resident_bytes = 0; //vbo + ibo bytes of resident buffers
+		uint32_t resident_buffers = 0;
+		uint32_t evictions = 0;
+		uint32_t reload_stalls = 0; //reloads caused by using an evicted buffer
+		double reload_stall_seconds = 0.0; //time spent in those reloads
+	} stats;
+
+	void report(std::ostream &out) const;
+
+	//internals:
+	uint64_t frame = 1;
+	//resident buffers, linked through MeshBuffer::residency:
+	MeshBuffer const *newest = nullptr;
+	MeshBuffer const *oldest = nullptr;
+	void link(MeshBuffer const &buffer);
+	void unlink(MeshBuffer const &buffer);
+};
+
+extern MeshResidency mesh_residency;
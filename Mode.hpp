@@ -3,6 +3,7 @@
 #include <SDL.h>
 #include <glm/glm.hpp>
 
+#include <functional>
 #include <memory>
 
 class Mode : public std::enable_shared_from_this< Mode > {
@@ -21,6 +22,12 @@ public:
 	//draw is called after update:
 	virtual void draw(glm::uvec2 const &drawable_size) = 0;
 
+	//extract is called after update to copy everything needed to draw this frame into a render snapshot:
+	// the returned function is called later (while the next update runs), so it must not read the mode's changing state.
+	//Modes that return nullptr (the default) get their draw function called instead, in sequence with update.
+	typedef std::function< void(glm::uvec2 const &drawable_size) > RenderFunction;
+	virtual RenderFunction extract() { return nullptr; }
+
 	//Mode::current is the Mode to which events are dispatched.
 	// use 'set_current' to change the current Mode (e.g., to switch to a menu)
 	static std::shared_ptr< Mode > current;
@@ -1,9 +1,23 @@
 #include "Scene.hpp"
 
+#include "ThreadPool.hpp"
+#include "ChunkFile.hpp"
+#include "MeshBuffer.hpp"
+#include "MeshResidency.hpp"
+
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <limits>
+#include <map>
+#include <cmath>
 
 glm::mat4 Scene::Transform::make_local_to_parent() const {
 	return glm::mat4( //translate
@@ -84,6 +98,7 @@ void Scene::Transform::set_parent(Transform *new_parent, Transform *before) {
 		next_sibling = prev_sibling = nullptr;
 	}
 	parent = new_parent;
+	dirty = true;
 	if (parent) {
 		//add to new parent:
 		if (before) {
@@ -101,72 +116,1050 @@ void Scene::Transform::set_parent(Transform *new_parent, Transform *before) {
 
 //---------------------------
 
-glm::mat4 Scene::Camera::make_projection() const {
-	return glm::infinitePerspective( fovy, aspect, near );
+namespace {
+	//the material most recently uploaded to each program:
+	// (uniform values are program state, so a material only needs to be re-sent
+	//  if it has changed or some other material has been uploaded to the same program)
+	std::unordered_map< GLuint, Scene::Material const * > &get_uploaded_materials() {
+		static std::unordered_map< GLuint, Scene::Material const * > uploaded_materials;
+		return uploaded_materials;
+	}
 }
 
-//---------------------------
+template< typename T >
+static void set_material_uniform(Scene::Material *material, GLuint location, GLenum type, T const &value) {
+	static_assert(sizeof(T) % sizeof(GLfloat) == 0, "values are stored as floats");
+	if (location == -1U) return;
+	auto f = std::find_if(material->uniforms.begin(), material->uniforms.end(), [&](Scene::Material::Uniform const &u){
+		return u.location == location;
+	});
+	if (f == material->uniforms.end()) {
+		material->uniforms.emplace_back();
+		f = material->uniforms.end() - 1;
+		f->location = location;
+		f->offset = uint32_t(material->values.size());
+		material->values.resize(material->values.size() + sizeof(T) / sizeof(GLfloat));
+	} else if (f->type != type) {
+		throw std::runtime_error("Material uniform " + std::to_string(location) + " was set with two different types.");
+	}
+	f->type = type;
+	std::memcpy(&material->values[f->offset], &value, sizeof(T));
+	material->version += 1;
+}
+
+void Scene::Material::set_uniform(GLuint location, float value) {
+	set_material_uniform(this, location, GL_FLOAT, value);
+}
+void Scene::Material::set_uniform(GLuint location, glm::vec2 const &value) {
+	set_material_uniform(this, location, GL_FLOAT_VEC2, value);
+}
+void Scene::Material::set_uniform(GLuint location, glm::vec3 const &value) {
+	set_material_uniform(this, location, GL_FLOAT_VEC3, value);
+}
+void Scene::Material::set_uniform(GLuint location, glm::vec4 const &value) {
+	set_material_uniform(this, location, GL_FLOAT_VEC4, value);
+}
+void Scene::Material::set_uniform(GLuint location, glm::mat4 const &value) {
+	set_material_uniform(this, location, GL_FLOAT_MAT4, value);
+}
+void Scene::Material::set_uniform(GLuint location, GLint value) {
+	set_material_uniform(this, location, GL_INT, value);
+}
 
-//templated helper functions to avoid having to write the same new/delete code three times:
-template< typename T, typename... Args >
-T *list_new(T * &first, Args&&... args) {
-	T *t = new T(std::forward< Args >(args)...); //"perfect forwarding"
-	if (first) {
-		t->alloc_next = first;
-		first->alloc_prev_next = &t->alloc_next;
+void Scene::Material::set_block(GLuint binding, void const *data, size_t size) {
+	block_binding = binding;
+	block_data.assign(reinterpret_cast< char const * >(data), reinterpret_cast< char const * >(data) + size);
+	version += 1;
+}
+
+void Scene::Material::upload() {
+	for (auto const &u : uniforms) {
+		GLfloat const *v = &values[u.offset];
+		if (u.type == GL_FLOAT) glUniform1fv(u.location, 1, v);
+		else if (u.type == GL_FLOAT_VEC2) glUniform2fv(u.location, 1, v);
+		else if (u.type == GL_FLOAT_VEC3) glUniform3fv(u.location, 1, v);
+		else if (u.type == GL_FLOAT_VEC4) glUniform4fv(u.location, 1, v);
+		else if (u.type == GL_FLOAT_MAT4) glUniformMatrix4fv(u.location, 1, GL_FALSE, v);
+		else if (u.type == GL_INT) glUniform1iv(u.location, 1, reinterpret_cast< GLint const * >(v));
+		else assert(0 && "Unknown material uniform type.");
 	}
-	t->alloc_prev_next = &first;
-	first = t;
-	return t;
+	if (block_binding != -1U && uploaded_version != version) {
+		if (block_buffer == 0) glGenBuffers(1, &block_buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, block_buffer);
+		glBufferData(GL_UNIFORM_BUFFER, block_data.size(), block_data.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	uploaded_version = version;
 }
 
-template< typename T >
-void list_delete(T * t) {
-	assert(t && "It is invalid to delete a null scene object [yes this is different than 'delete']");
-	assert(t->alloc_prev_next);
-	if (t->alloc_next) {
-		t->alloc_next->alloc_prev_next = t->alloc_prev_next;
+Scene::Material::~Material() {
+	if (block_buffer != 0) {
+		glDeleteBuffers(1, &block_buffer);
+		block_buffer = 0;
 	}
-	*t->alloc_prev_next = t->alloc_next;
-	//PARANOIA:
-	t->alloc_next = nullptr;
-	t->alloc_prev_next = nullptr;
 }
 
+//---------------------------
+
+glm::mat4 Scene::Camera::make_projection() const {
+	return glm::infinitePerspective( fovy, aspect, near );
+}
+
+//---------------------------
+
 Scene::Transform *Scene::new_transform() {
-	return list_new< Scene::Transform >(first_transform);
+	return transforms.create();
 }
 
 void Scene::delete_transform(Scene::Transform *transform) {
-	list_delete< Scene::Transform >(transform);
+	transforms.erase(transform);
+}
+
+bool Scene::delete_transform(TransformHandle h) {
+	Scene::Transform *transform = transforms.get(h);
+	if (!transform) return false;
+	delete_transform(transform);
+	return true;
+}
+
+//remove an object from its grid cell by swapping the last object in the cell into its slot:
+static void grid_remove(Scene::Grid *grid, Scene::Object *object) {
+	auto f = grid->cells.find(object->grid_cell);
+	assert(f != grid->cells.end());
+	std::vector< Scene::Object * > &list = f->second;
+	assert(object->grid_slot < list.size() && list[object->grid_slot] == object);
+	list[object->grid_slot] = list.back();
+	list[object->grid_slot]->grid_slot = object->grid_slot;
+	list.pop_back();
+	if (list.empty()) grid->cells.erase(f);
+	object->grid_slot = -1U;
 }
 
 Scene::Object *Scene::new_object(Scene::Transform *transform) {
 	assert(transform && "Scene::Object must be attached to a transform.");
-	return list_new< Scene::Object >(first_object, transform);
+	return objects.create(transform);
 }
 
 void Scene::delete_object(Scene::Object *object) {
-	list_delete< Scene::Object >(object);
+	assert(object && "It is invalid to delete a null scene object [yes this is different than 'delete']");
+	if (object->grid_slot != -1U) grid_remove(&grid, object);
+	objects.erase(object);
+}
+
+bool Scene::delete_object(ObjectHandle h) {
+	Scene::Object *object = objects.get(h);
+	if (!object) return false;
+	delete_object(object);
+	return true;
+}
+
+Scene::Material *Scene::new_material() {
+	return materials.create();
+}
+
+void Scene::delete_material(Scene::Material *material) {
+	auto &uploaded_materials = get_uploaded_materials();
+	for (auto m = uploaded_materials.begin(); m != uploaded_materials.end(); /* later */) {
+		if (m->second == material) m = uploaded_materials.erase(m);
+		else ++m;
+	}
+	materials.erase(material);
+}
+
+bool Scene::delete_material(MaterialHandle h) {
+	Scene::Material *material = materials.get(h);
+	if (!material) return false;
+	delete_material(material);
+	return true;
 }
 
 Scene::Camera *Scene::new_camera(Scene::Transform *transform) {
 	assert(transform && "Scene::Camera must be attached to a transform.");
-	return list_new< Scene::Camera >(first_camera, transform);
+	return cameras.create(transform);
 }
 
 void Scene::delete_camera(Scene::Camera *object) {
-	list_delete< Scene::Camera >(object);
+	cameras.erase(object);
+}
+
+bool Scene::delete_camera(CameraHandle h) {
+	Scene::Camera *camera = cameras.get(h);
+	if (!camera) return false;
+	delete_camera(camera);
+	return true;
+}
+
+void Scene::load(std::string const &filename,
+	std::function< void(Scene &, Transform *, std::string const &) > const &on_object) {
+
+	auto before = std::chrono::high_resolution_clock::now();
+
+	//chunks are looked up in the file's table of contents (so their order doesn't matter, and unused chunks are skipped):
+	ChunkFile file(filename);
+
+	std::vector< char > strings;
+	file.read("str0", &strings);
+
+	struct HierarchyEntry {
+		int32_t parent;
+		uint32_t name_begin, name_end;
+		glm::vec3 position;
+		glm::vec4 rotation; //stored x,y,z,w
+		glm::vec3 scale;
+	};
+	static_assert(sizeof(HierarchyEntry) == 4 + 4*2 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
+	std::vector< HierarchyEntry > hierarchy;
+	file.read("xfh0", &hierarchy);
+
+	struct MeshEntry {
+		uint32_t transform;
+		uint32_t name_begin, name_end;
+	};
+	static_assert(sizeof(MeshEntry) == 4 + 4*2, "MeshEntry is packed.");
+	std::vector< MeshEntry > meshes;
+	file.read("msh0", &meshes);
+
+	struct CameraEntry {
+		uint32_t transform;
+		char type[4]; //"pers" or "orth"
+		float data; //fov in degrees for 'pers', scale for 'orth'
+		float clip_near, clip_far;
+	};
+	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4*2, "CameraEntry is packed.");
+	std::vector< CameraEntry > cameras;
+	file.read("cam0", &cameras);
+
+	//(Scene doesn't support lamps yet, so the 'lmp0' chunk is skipped)
+
+	auto get_name = [&strings](uint32_t begin, uint32_t end) {
+		if (!(begin <= end && end <= strings.size())) {
+			throw std::runtime_error("scene entry has out-of-range name begin/end");
+		}
+		return std::string(strings.data() + begin, strings.data() + end);
+	};
+
+	//storage for everything the file creates is allocated up front:
+	// (objects are created by on_object, usually one per mesh reference)
+	this->transforms.reserve(hierarchy.size());
+	this->objects.reserve(meshes.size());
+	this->cameras.reserve(cameras.size());
+
+	//build transforms in file order (the exporter writes parents before their children):
+	std::vector< Scene::Transform * > transforms;
+	transforms.reserve(hierarchy.size());
+	for (auto const &h : hierarchy) {
+		Scene::Transform *transform = new_transform();
+		if (h.parent >= 0) {
+			if (uint32_t(h.parent) >= transforms.size()) {
+				throw std::runtime_error("scene transform refers to a parent that does not precede it");
+			}
+			transform->set_parent(transforms[h.parent]);
+		}
+		transform->position = h.position;
+		transform->rotation = glm::quat(h.rotation.w, h.rotation.x, h.rotation.y, h.rotation.z);
+		transform->scale = h.scale;
+		transforms.emplace_back(transform);
+	}
+
+	auto get_transform = [&transforms](uint32_t index) {
+		if (index >= transforms.size()) {
+			throw std::runtime_error("scene entry refers to out-of-range transform");
+		}
+		return transforms[index];
+	};
+
+	for (auto const &m : meshes) {
+		Scene::Transform *transform = get_transform(m.transform);
+		if (on_object) {
+			on_object(*this, transform, get_name(m.name_begin, m.name_end));
+		}
+	}
+
+	for (auto const &c : cameras) {
+		Scene::Transform *transform = get_transform(c.transform);
+		if (std::string(c.type, 4) != "pers") {
+			std::cerr << "WARNING: skipping unsupported camera type '" << std::string(c.type, 4) << "' in scene '" << filename << "'." << std::endl;
+			continue;
+		}
+		Scene::Camera *camera = new_camera(transform);
+		camera->fovy = glm::radians(c.data);
+		camera->near = c.clip_near;
+	}
+
+	auto after = std::chrono::high_resolution_clock::now();
+	double ms = std::chrono::duration< double >(after - before).count() * 1000.0;
+	std::cout << "Loaded scene '" << filename << "': " << transforms.size() << " transforms, "
+		<< meshes.size() << " meshes, " << cameras.size() << " cameras in " << ms << " ms";
+	if (!transforms.empty()) {
+		std::cout << " (" << ms / transforms.size() * 1000.0 << " ms per 1000 transforms)";
+	}
+	std::cout << "." << std::endl;
+}
+
+//Snapshot layout: a SnapshotHeader followed by arrays of each of the entry types below:
+namespace {
+	struct SnapshotHeader {
+		char magic[4];
+		uint32_t transforms, objects, cameras, materials;
+		uint32_t lods; //total over all objects
+	};
+	struct TransformEntry {
+		int32_t parent; //index of parent in transform list, or -1
+		glm::vec3 position;
+		glm::quat rotation;
+		glm::vec3 scale;
+	};
+	struct ObjectEntry {
+		uint32_t transform; //index in transform list
+		int32_t material; //index in material list, or -1
+		GLuint vao, start, count;
+		GLenum index_type;
+		glm::vec3 position_scale, position_bias;
+		MeshBuffer const *mesh_buffer;
+		glm::vec3 lod_center;
+		float lod_radius;
+		uint32_t lod;
+		uint32_t lods; //number of this object's entries in the LOD entry list
+		uint8_t is_static, baked;
+		//NOTE: object entries follow the transform entries, so may not be aligned for the pointer; they are accessed with memcpy
+	};
+	struct CameraEntry {
+		uint32_t transform; //index in transform list
+		float fovy, aspect, near, distance;
+	};
+	struct LODEntry { //(each object's levels, in object order)
+		GLuint start, count;
+		glm::vec3 position_scale, position_bias;
+	};
+}
+
+void Scene::save(Snapshot *snapshot) const {
+	assert(snapshot);
+
+	std::unordered_map< Scene::Transform const *, uint32_t > transform_index;
+	for (auto const &t : transforms) transform_index.insert(std::make_pair(t, uint32_t(transform_index.size())));
+	std::unordered_map< Scene::Material const *, uint32_t > material_index;
+	for (auto const &m : materials) material_index.insert(std::make_pair(m, uint32_t(material_index.size())));
+
+	uint32_t lods = 0;
+	for (auto const &o : objects) lods += uint32_t(o->lods.size());
+
+	snapshot->data.resize(
+		sizeof(SnapshotHeader)
+		+ transforms.size() * sizeof(TransformEntry)
+		+ objects.size() * sizeof(ObjectEntry)
+		+ cameras.size() * sizeof(CameraEntry)
+		+ lods * sizeof(LODEntry)
+	);
+	char *at = snapshot->data.data();
+
+	SnapshotHeader &header = *reinterpret_cast< SnapshotHeader * >(at);
+	std::memcpy(header.magic, "snp1", 4);
+	header.transforms = uint32_t(transforms.size());
+	header.objects = uint32_t(objects.size());
+	header.cameras = uint32_t(cameras.size());
+	header.materials = uint32_t(materials.size());
+	header.lods = lods;
+	at += sizeof(SnapshotHeader);
+
+	for (auto const &t : transforms) {
+		TransformEntry &entry = *reinterpret_cast< TransformEntry * >(at);
+		entry.parent = (t->parent ? int32_t(transform_index.at(t->parent)) : -1);
+		entry.position = t->position;
+		entry.rotation = t->rotation;
+		entry.scale = t->scale;
+		at += sizeof(TransformEntry);
+	}
+	for (auto const &o : objects) {
+		ObjectEntry entry;
+		entry.transform = transform_index.at(o->transform);
+		entry.material = (o->material ? int32_t(material_index.at(o->material)) : -1);
+		entry.vao = o->vao;
+		entry.start = o->start;
+		entry.count = o->count;
+		entry.index_type = o->index_type;
+		entry.position_scale = o->position_scale;
+		entry.position_bias = o->position_bias;
+		entry.mesh_buffer = o->mesh_buffer;
+		entry.lod_center = o->lod_center;
+		entry.lod_radius = o->lod_radius;
+		entry.lod = o->lod;
+		entry.lods = uint32_t(o->lods.size());
+		entry.is_static = (o->is_static ? 1 : 0);
+		entry.baked = (o->baked ? 1 : 0);
+		std::memcpy(at, &entry, sizeof(ObjectEntry));
+		at += sizeof(ObjectEntry);
+	}
+	for (auto const &c : cameras) {
+		CameraEntry &entry = *reinterpret_cast< CameraEntry * >(at);
+		entry.transform = transform_index.at(c->transform);
+		entry.fovy = c->fovy;
+		entry.aspect = c->aspect;
+		entry.near = c->near;
+		entry.distance = c->distance;
+		at += sizeof(CameraEntry);
+	}
+	for (auto const &o : objects) {
+		for (auto const &l : o->lods) {
+			LODEntry &entry = *reinterpret_cast< LODEntry * >(at);
+			entry.start = l.start;
+			entry.count = l.count;
+			entry.position_scale = l.position_scale;
+			entry.position_bias = l.position_bias;
+			at += sizeof(LODEntry);
+		}
+	}
+	assert(at == snapshot->data.data() + snapshot->data.size());
+}
+
+void Scene::restore(Snapshot const &snapshot) {
+	if (snapshot.data.size() < sizeof(SnapshotHeader)) {
+		throw std::runtime_error("Scene snapshot is too small to contain a header.");
+	}
+	SnapshotHeader header;
+	std::memcpy(&header, snapshot.data.data(), sizeof(SnapshotHeader));
+	if (std::string(header.magic, 4) != "snp1") {
+		throw std::runtime_error("Scene snapshot has unexpected magic number.");
+	}
+	if (snapshot.data.size() != sizeof(SnapshotHeader)
+		+ header.transforms * sizeof(TransformEntry)
+		+ header.objects * sizeof(ObjectEntry)
+		+ header.cameras * sizeof(CameraEntry)
+		+ header.lods * sizeof(LODEntry)) {
+		throw std::runtime_error("Scene snapshot size doesn't match its header.");
+	}
+	TransformEntry const *transform_entries = reinterpret_cast< TransformEntry const * >(snapshot.data.data() + sizeof(SnapshotHeader));
+	char const *object_data = reinterpret_cast< char const * >(transform_entries + header.transforms);
+	auto object_entry = [object_data](uint32_t i) {
+		ObjectEntry entry;
+		std::memcpy(&entry, object_data + i * sizeof(ObjectEntry), sizeof(ObjectEntry));
+		return entry;
+	};
+	CameraEntry const *camera_entries = reinterpret_cast< CameraEntry const * >(object_data + header.objects * sizeof(ObjectEntry));
+	LODEntry const *lod_entries = reinterpret_cast< LODEntry const * >(camera_entries + header.cameras);
+
+	if (materials.size() != header.materials) {
+		throw std::runtime_error("Scene snapshot was saved with a different set of materials.");
+	}
+
+	if (transforms.size() != header.transforms || objects.size() != header.objects || cameras.size() != header.cameras) {
+		//structure has changed; start over with fresh transforms/objects/cameras:
+		while (!cameras.empty()) delete_camera(cameras.back());
+		while (!objects.empty()) delete_object(objects.back());
+		while (!transforms.empty()) delete_transform(transforms.back());
+		//(slot maps list new things in creation order, so this recreates the saved order)
+		for (uint32_t i = 0; i < header.transforms; ++i) new_transform();
+		for (uint32_t i = 0; i < header.objects; ++i) {
+			ObjectEntry entry = object_entry(i);
+			if (entry.transform >= header.transforms) {
+				throw std::runtime_error("Scene snapshot object refers to out-of-range transform.");
+			}
+			new_object(transforms.all()[entry.transform]);
+		}
+		for (uint32_t i = 0; i < header.cameras; ++i) {
+			if (camera_entries[i].transform >= header.transforms) {
+				throw std::runtime_error("Scene snapshot camera refers to out-of-range transform.");
+			}
+			new_camera(transforms.all()[camera_entries[i].transform]);
+		}
+	}
+
+	std::vector< Scene::Transform * > const &transform_list = transforms.all();
+	std::vector< Scene::Object * > const &object_list = objects.all();
+	std::vector< Scene::Camera * > const &camera_list = cameras.all();
+	std::vector< Scene::Material * > const &material_list = materials.all();
+
+	for (uint32_t i = 0; i < header.transforms; ++i) {
+		TransformEntry const &entry = transform_entries[i];
+		Scene::Transform *t = transform_list[i];
+		Scene::Transform *parent = (entry.parent < 0 ? nullptr : transform_list.at(entry.parent));
+		if (t->parent != parent) t->set_parent(parent);
+		t->position = entry.position;
+		t->rotation = entry.rotation;
+		t->scale = entry.scale;
+	}
+	uint32_t lod_entry = 0;
+	for (uint32_t i = 0; i < header.objects; ++i) {
+		ObjectEntry entry = object_entry(i);
+		Scene::Object *o = object_list[i];
+		if (entry.transform >= transform_list.size()) {
+			throw std::runtime_error("Scene snapshot object refers to out-of-range transform.");
+		}
+		if (o->transform != transform_list[entry.transform]) {
+			//(re-filed on the next update_grid(), since the new transform may not be recomputed)
+			if (o->grid_slot != -1U) grid_remove(&grid, o);
+			o->transform = transform_list[entry.transform];
+		}
+		o->material = (entry.material < 0 ? nullptr : material_list.at(entry.material));
+		o->vao = entry.vao;
+		o->start = entry.start;
+		o->count = entry.count;
+		o->index_type = entry.index_type;
+		o->position_scale = entry.position_scale;
+		o->position_bias = entry.position_bias;
+		o->mesh_buffer = entry.mesh_buffer;
+		if (entry.lods > header.lods - lod_entry) {
+			throw std::runtime_error("Scene snapshot object refers to out-of-range LOD entries.");
+		}
+		o->lods.resize(entry.lods);
+		for (auto &l : o->lods) {
+			LODEntry const &lod = lod_entries[lod_entry++];
+			l.start = lod.start;
+			l.count = lod.count;
+			l.position_scale = lod.position_scale;
+			l.position_bias = lod.position_bias;
+		}
+		o->lod_center = entry.lod_center;
+		o->lod_radius = entry.lod_radius;
+		o->lod = entry.lod;
+		o->is_static = (entry.is_static != 0);
+		o->baked = (entry.baked != 0);
+	}
+	for (uint32_t i = 0; i < header.cameras; ++i) {
+		CameraEntry const &entry = camera_entries[i];
+		Scene::Camera *c = camera_list[i];
+		if (entry.transform >= transform_list.size()) {
+			throw std::runtime_error("Scene snapshot camera refers to out-of-range transform.");
+		}
+		c->transform = transform_list[entry.transform];
+		c->fovy = entry.fovy;
+		c->aspect = entry.aspect;
+		c->near = entry.near;
+		c->distance = entry.distance;
+	}
+}
+
+//compute world matrices for a transform and all of its descendants:
+// (skips recomputing transforms that haven't changed, unless their parent did; returns number recomputed)
+static uint32_t update_subtree(Scene::Transform *transform, Scene::Transform const *parent, bool parent_changed, uint32_t update_count) {
+	bool changed = parent_changed || transform->dirty
+		|| transform->position != transform->cached_position
+		|| transform->rotation != transform->cached_rotation
+		|| transform->scale != transform->cached_scale;
+	uint32_t recomputed = 0;
+	if (changed) {
+		glm::mat4 local_to_parent = transform->make_local_to_parent();
+		bool uniform_scale = (transform->scale.x == transform->scale.y && transform->scale.y == transform->scale.z);
+		if (parent) {
+			transform->local_to_world = parent->local_to_world * local_to_parent;
+			uniform_scale = uniform_scale && parent->uniform_scale;
+		} else {
+			transform->local_to_world = local_to_parent;
+		}
+		transform->uniform_scale = uniform_scale;
+
+		glm::mat3 m = glm::mat3(transform->local_to_world);
+		float scale2 = glm::dot(m[0], m[0]);
+		if (uniform_scale && scale2 != 0.0f) {
+			//rotation times uniform scale 's': inverse transpose is the same matrix divided by s^2:
+			transform->normal_to_world = m * (1.0f / scale2);
+		} else {
+			//inverse transpose of (rotation * scale) is (rotation * inverse scale):
+			glm::vec3 inv_scale;
+			inv_scale.x = (transform->scale.x == 0.0f ? 0.0f : 1.0f / transform->scale.x);
+			inv_scale.y = (transform->scale.y == 0.0f ? 0.0f : 1.0f / transform->scale.y);
+			inv_scale.z = (transform->scale.z == 0.0f ? 0.0f : 1.0f / transform->scale.z);
+			glm::mat3 local_normal = glm::mat3_cast(transform->rotation) * glm::mat3(
+				glm::vec3(inv_scale.x, 0.0f, 0.0f),
+				glm::vec3(0.0f, inv_scale.y, 0.0f),
+				glm::vec3(0.0f, 0.0f, inv_scale.z)
+			);
+			transform->normal_to_world = (parent ? parent->normal_to_world * local_normal : local_normal);
+		}
+
+		transform->cached_position = transform->position;
+		transform->cached_rotation = transform->rotation;
+		transform->cached_scale = transform->scale;
+		transform->dirty = false;
+		transform->recomputed_in = update_count;
+		recomputed += 1;
+	}
+	for (Scene::Transform *child = transform->last_child; child != nullptr; child = child->prev_sibling) {
+		recomputed += update_subtree(child, transform, changed, update_count);
+	}
+	return recomputed;
+}
+
+void Scene::update_transforms(ThreadPool *pool) {
+	update_count += 1;
+	uint32_t count = update_count;
+
+	//roots partition the hierarchy into independent subtrees:
+	std::vector< Scene::Transform * > roots;
+	for (Scene::Transform *transform : transforms) {
+		if (transform->parent == nullptr) roots.emplace_back(transform);
+	}
+
+	std::vector< uint32_t > recomputed(roots.size(), 0);
+	if (pool && pool->size() > 1 && roots.size() > 1) {
+		//each subtree only writes its own transforms, so no locking is needed:
+		pool->parallel_for(uint32_t(roots.size()), [&roots,&recomputed,count](uint32_t i){
+			recomputed[i] = update_subtree(roots[i], nullptr, false, count);
+		});
+	} else {
+		for (uint32_t i = 0; i < roots.size(); ++i) {
+			recomputed[i] = update_subtree(roots[i], nullptr, false, count);
+		}
+	}
+
+	update_stats.transforms = uint32_t(transforms.size());
+	update_stats.recomputed = 0;
+	for (auto count : recomputed) update_stats.recomputed += count;
+
+	update_grid();
+}
+
+//grid cell coordinates are packed into a 64-bit key, 21 bits per axis:
+static glm::ivec3 grid_coord(glm::vec3 const &position, float cell_size) {
+	return glm::ivec3(glm::floor(position / cell_size));
+}
+
+static uint64_t grid_key(glm::ivec3 const &coord) {
+	return (uint64_t(uint32_t(coord.x) & 0x1fffff) << 42)
+	     | (uint64_t(uint32_t(coord.y) & 0x1fffff) << 21)
+	     | (uint64_t(uint32_t(coord.z) & 0x1fffff));
+}
+
+void Scene::update_grid() {
+	for (Scene::Object *object : objects) {
+		//objects whose transforms weren't recomputed haven't moved:
+		if (object->grid_slot != -1U && object->transform->recomputed_in != update_count) continue;
+		uint64_t key = grid_key(grid_coord(glm::vec3(object->transform->local_to_world[3]), grid.cell_size));
+		if (object->grid_slot != -1U) {
+			if (object->grid_cell == key) continue;
+			grid_remove(&grid, object);
+		}
+		//add to new cell:
+		std::vector< Scene::Object * > &list = grid.cells[key];
+		object->grid_cell = key;
+		object->grid_slot = uint32_t(list.size());
+		list.emplace_back(object);
+	}
+}
+
+void Scene::clear_grid() {
+	grid.cells.clear();
+	for (Scene::Object *object : objects) {
+		object->grid_slot = -1U;
+	}
+}
+
+void Scene::query_box(glm::vec3 const &min, glm::vec3 const &max, std::vector< Scene::Object * > *out) const {
+	assert(out);
+	glm::ivec3 lo = grid_coord(min, grid.cell_size);
+	glm::ivec3 hi = grid_coord(max, grid.cell_size);
+	for (int32_t z = lo.z; z <= hi.z; ++z) {
+		for (int32_t y = lo.y; y <= hi.y; ++y) {
+			for (int32_t x = lo.x; x <= hi.x; ++x) {
+				auto f = grid.cells.find(grid_key(glm::ivec3(x, y, z)));
+				if (f == grid.cells.end()) continue;
+				for (auto object : f->second) {
+					glm::vec3 at = glm::vec3(object->transform->local_to_world[3]);
+					if (min.x <= at.x && at.x <= max.x
+					 && min.y <= at.y && at.y <= max.y
+					 && min.z <= at.z && at.z <= max.z) {
+						out->emplace_back(object);
+					}
+				}
+			}
+		}
+	}
+}
+
+void Scene::query_radius(glm::vec3 const &center, float radius, std::vector< Scene::Object * > *out) const {
+	assert(out);
+	size_t begin = out->size();
+	query_box(center - glm::vec3(radius), center + glm::vec3(radius), out);
+	//discard box corners:
+	auto end = std::remove_if(out->begin() + begin, out->end(), [&](Scene::Object *object){
+		glm::vec3 to = glm::vec3(object->transform->local_to_world[3]) - center;
+		return glm::dot(to, to) > radius * radius;
+	});
+	out->erase(end, out->end());
+}
+
+void Scene::bake_static() {
+	clear_static();
+	update_transforms(update_pool);
+
+	//group static objects by material and source buffer (so each group shares a program and vertex layout):
+	std::map< std::pair< Scene::Material *, MeshBuffer const * >, std::vector< Scene::Object * > > groups;
+	for (Scene::Object *object : objects) {
+		if (!object->is_static) continue;
+		if (!object->material || !object->mesh_buffer) {
+			std::cerr << "WARNING: static object without material or mesh_buffer will not be baked." << std::endl;
+			continue;
+		}
+		groups[std::make_pair(object->material, object->mesh_buffer)].emplace_back(object);
+	}
+
+	for (auto const &group : groups) {
+		Scene::Material *material = group.first.first;
+		MeshBuffer const &buffer = *group.first.second;
+		if (buffer.Position.size != 3 || (buffer.Position.type != GL_FLOAT && buffer.Position.type != GL_SHORT)
+		 || (buffer.Normal.size != 0 && buffer.Normal.type != GL_FLOAT && buffer.Normal.type != GL_INT_2_10_10_10_REV)) {
+			std::cerr << "WARNING: can only bake static objects from buffers with float or quantized (see MeshBuffer) positions and normals." << std::endl;
+			continue;
+		}
+		GLsizei stride = buffer.Position.stride;
+
+		//read back source vertices (and indices):
+		mesh_residency.use(buffer);
+		GLint source_size = 0;
+		glBindBuffer(GL_ARRAY_BUFFER, buffer.vbo);
+		glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &source_size);
+		std::vector< char > source(source_size);
+		glGetBufferSubData(GL_ARRAY_BUFFER, 0, source_size, source.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		GLuint source_vertices = GLuint(source_size / stride);
+
+		std::vector< uint32_t > source_indices;
+		if (buffer.ibo) {
+			GLint index_size = 0;
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer.ibo);
+			glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &index_size);
+			if (buffer.index_type == GL_UNSIGNED_SHORT) {
+				std::vector< uint16_t > shorts(index_size / sizeof(uint16_t));
+				glGetBufferSubData(GL_COPY_READ_BUFFER, 0, shorts.size() * sizeof(uint16_t), shorts.data());
+				source_indices.assign(shorts.begin(), shorts.end());
+			} else {
+				source_indices.resize(index_size / sizeof(uint32_t));
+				glGetBufferSubData(GL_COPY_READ_BUFFER, 0, source_indices.size() * sizeof(uint32_t), source_indices.data());
+			}
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		}
+
+		//copy the vertices used by every object, moving positions and normals to world space:
+		// (positions are written once all are known, since quantized batches are scaled to fit their bounds)
+		std::vector< char > baked;
+		std::vector< uint32_t > baked_indices;
+		std::vector< glm::vec3 > baked_positions;
+		for (auto object : group.second) {
+			bool indexed = (object->index_type != 0);
+			if (indexed && !buffer.ibo) {
+				throw std::runtime_error("Indexed static object's mesh buffer has no element buffer.");
+			}
+			if (object->start + object->count > (indexed ? GLuint(source_indices.size()) : source_vertices)) {
+				throw std::runtime_error("Static object's range is outside its mesh buffer.");
+			}
+			glm::mat4 const &local_to_world = object->transform->local_to_world;
+			glm::mat3 const &normal_to_world = object->transform->normal_to_world;
+			std::unordered_map< uint32_t, uint32_t > copied; //source vertex -> baked vertex
+			for (GLuint i = object->start; i < object->start + object->count; ++i) {
+				uint32_t v = (indexed ? source_indices[i] : i);
+				if (v >= source_vertices) {
+					throw std::runtime_error("Static object's mesh buffer has an out-of-range index.");
+				}
+				auto f = copied.insert(std::make_pair(v, uint32_t(baked.size() / stride)));
+				baked_indices.emplace_back(f.first->second);
+				if (!f.second) continue;
+
+				size_t at = baked.size();
+				baked.insert(baked.end(), source.begin() + v * stride, source.begin() + (v + 1) * stride);
+				glm::vec3 position = object->position_scale * buffer.read_position(&baked[at]) + object->position_bias;
+				baked_positions.emplace_back(local_to_world * glm::vec4(position, 1.0f));
+				if (buffer.Normal.size != 0) {
+					buffer.write_normal(&baked[at], glm::normalize(normal_to_world * buffer.read_normal(&baked[at])));
+				}
+			}
+			object->baked = true;
+		}
+
+		glm::vec3 position_scale = glm::vec3(1.0f);
+		glm::vec3 position_bias = glm::vec3(0.0f);
+		if (buffer.Position.type != GL_FLOAT && !baked_positions.empty()) {
+			glm::vec3 min = baked_positions[0];
+			glm::vec3 max = min;
+			for (auto const &position : baked_positions) {
+				min = glm::min(min, position);
+				max = glm::max(max, position);
+			}
+			position_bias = 0.5f * (max + min);
+			position_scale = glm::max(0.5f * (max - min), glm::vec3(1e-20f));
+		}
+		for (uint32_t v = 0; v < baked_positions.size(); ++v) {
+			buffer.write_position(&baked[v * stride], (baked_positions[v] - position_bias) / position_scale);
+		}
+
+		static_batches.emplace_back();
+		StaticBatch &batch = static_batches.back();
+		batch.material = material;
+		batch.count = GLuint(baked_indices.size());
+		batch.position_scale = position_scale;
+		batch.position_bias = position_bias;
+		glGenBuffers(1, &batch.vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, batch.vbo);
+		glBufferData(GL_ARRAY_BUFFER, baked.size(), baked.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glGenBuffers(1, &batch.ibo);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, batch.ibo);
+		glBufferData(GL_COPY_WRITE_BUFFER, baked_indices.size() * sizeof(uint32_t), baked_indices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		batch.vao = buffer.make_vao_for_program(material->program, batch.vbo, batch.ibo);
+	}
+}
+
+void Scene::clear_static() {
+	for (auto &batch : static_batches) {
+		glDeleteVertexArrays(1, &batch.vao);
+		glDeleteBuffers(1, &batch.vbo);
+		glDeleteBuffers(1, &batch.ibo);
+	}
+	static_batches.clear();
+	for (Scene::Object *object : objects) {
+		object->baked = false;
+	}
+}
+
+//matrix that decodes stored (e.g. quantized) mesh positions, position_scale * stored + position_bias:
+static glm::mat4 mesh_to_local(glm::vec3 const &position_scale, glm::vec3 const &position_bias) {
+	return glm::mat4(
+		glm::vec4(position_scale.x, 0.0f, 0.0f, 0.0f),
+		glm::vec4(0.0f, position_scale.y, 0.0f, 0.0f),
+		glm::vec4(0.0f, 0.0f, position_scale.z, 0.0f),
+		glm::vec4(position_bias, 1.0f)
+	);
+}
+
+//pick a level of detail for an object whose bounding sphere covers 'size' of the viewport height:
+static uint32_t select_lod(Scene::Object &object, float size, float lod_threshold, float lod_hysteresis) {
+	uint32_t lod = std::min(object.lod, uint32_t(object.lods.size()) - 1);
+	//coarser while too small for the current level, finer while too big:
+	while (lod + 1 < object.lods.size() && size < lod_threshold * std::pow(0.5f, float(lod)) * (1.0f - lod_hysteresis)) ++lod;
+	while (lod > 0 && size > lod_threshold * std::pow(0.5f, float(lod - 1)) * (1.0f + lod_hysteresis)) --lod;
+	object.lod = lod;
+	return lod;
+}
+
+//order opaque items nearest-first, then transparent items in their original order:
+// (sorts small keys rather than moving DrawItems around)
+static void sort_front_to_back(std::vector< Scene::DrawItem > *items) {
+	std::vector< std::pair< float, uint32_t > > keys;
+	keys.reserve(items->size());
+	for (uint32_t i = 0; i < items->size(); ++i) {
+		Scene::DrawItem const &item = (*items)[i];
+		keys.emplace_back(item.material->transparent ? std::numeric_limits< float >::infinity() : item.depth, i);
+	}
+	std::stable_sort(keys.begin(), keys.end(), [items](std::pair< float, uint32_t > const &a, std::pair< float, uint32_t > const &b) {
+		bool a_transparent = (*items)[a.second].material->transparent;
+		bool b_transparent = (*items)[b.second].material->transparent;
+		if (a_transparent != b_transparent) return b_transparent;
+		return a.first < b.first;
+	});
+	std::vector< Scene::DrawItem > sorted;
+	sorted.reserve(items->size());
+	for (auto const &key : keys) sorted.emplace_back((*items)[key.second]);
+	items->swap(sorted);
+}
+
+void Scene::gather_views(std::vector< View > *views_) {
+	assert(views_);
+	std::vector< View > &views = *views_;
+
+	//per-view values used while testing objects:
+	struct Cull {
+		glm::mat4 world_to_camera;
+		glm::vec4 planes[5]; //left, right, bottom, top, near (inside when dot(plane, point) >= 0)
+		float lod_scale; //converts (radius / depth) to fraction of the viewport height
+	};
+	std::vector< Cull > culls(views.size());
+	for (uint32_t v = 0; v < views.size(); ++v) {
+		View &view = views[v];
+		assert(view.camera && "Views must have a camera.");
+		view.world_to_camera = view.camera->transform->make_world_to_local();
+		view.fovy = view.camera->fovy;
+		view.near = view.camera->near;
+		view.items.clear();
+
+		Cull &cull = culls[v];
+		cull.world_to_camera = view.world_to_camera;
+		cull.lod_scale = 1.0f / std::tan(0.5f * view.fovy);
+		//frustum planes from the rows of the world-to-clip matrix (the far plane is at infinity):
+		glm::mat4 clip = glm::transpose(glm::infinitePerspective(view.fovy, view.aspect, view.near) * view.world_to_camera);
+		cull.planes[0] = clip[3] + clip[0];
+		cull.planes[1] = clip[3] - clip[0];
+		cull.planes[2] = clip[3] + clip[1];
+		cull.planes[3] = clip[3] - clip[1];
+		cull.planes[4] = clip[3] + clip[2];
+		for (auto &plane : cull.planes) {
+			plane /= glm::length(glm::vec3(plane));
+		}
+	}
+
+	//one pass over the objects for all views:
+	std::vector< uint32_t > visible; //views that can see the current object
+	std::vector< float > depths; //object's depth in each of those views
+	for (Scene::Object *object : objects) {
+		if (object->baked) continue; //drawn as part of a static batch
+		assert(object->material && "Objects must have a material to be drawn.");
+
+		glm::mat4 const &local_to_world = object->transform->local_to_world;
+		glm::vec4 center = local_to_world * glm::vec4(object->lod_center, 1.0f);
+		float scale = std::max(glm::length(glm::vec3(local_to_world[0])), std::max(glm::length(glm::vec3(local_to_world[1])), glm::length(glm::vec3(local_to_world[2]))));
+		float radius = object->lod_radius * scale;
+
+		visible.clear();
+		depths.clear();
+		float size = 0.0f; //largest projected size over all views
+		for (uint32_t v = 0; v < views.size(); ++v) {
+			Cull const &cull = culls[v];
+			if (views[v].cull && object->lod_radius > 0.0f) {
+				bool inside = true;
+				for (auto const &plane : cull.planes) {
+					if (glm::dot(plane, center) < -radius) {
+						inside = false;
+						break;
+					}
+				}
+				if (!inside) continue;
+			}
+			float depth = -(cull.world_to_camera * center).z;
+			size = std::max(size, (depth > 0.0f ? radius / depth * cull.lod_scale : std::numeric_limits< float >::infinity()));
+			visible.emplace_back(v);
+			depths.emplace_back(depth);
+		}
+		if (visible.empty()) continue;
+
+		DrawItem item;
+		item.material = object->material;
+		item.vao = object->vao;
+		item.mesh_buffer = object->mesh_buffer;
+		item.start = object->start;
+		item.count = object->count;
+		item.index_type = object->index_type;
+		item.local_to_world = local_to_world * mesh_to_local(object->position_scale, object->position_bias);
+		item.normal_to_world = object->transform->normal_to_world;
+		if (!object->lods.empty()) {
+			uint32_t lod = select_lod(*object, size, lod_threshold, lod_hysteresis);
+			item.start = object->lods[lod].start;
+			item.count = object->lods[lod].count;
+			item.local_to_world = local_to_world * mesh_to_local(object->lods[lod].position_scale, object->lods[lod].position_bias);
+		}
+		for (uint32_t i = 0; i < visible.size(); ++i) {
+			item.depth = depths[i];
+			views[visible[i]].items.emplace_back(item);
+		}
+	}
+
+	for (auto &view : views) {
+		//static batches are already in world space:
+		for (auto const &batch : static_batches) {
+			view.items.emplace_back();
+			DrawItem &item = view.items.back();
+			item.material = batch.material;
+			item.vao = batch.vao;
+			item.start = 0;
+			item.count = batch.count;
+			item.index_type = GL_UNSIGNED_INT;
+			item.local_to_world = mesh_to_local(batch.position_scale, batch.position_bias);
+			item.normal_to_world = glm::mat3(1.0f);
+			//batches are large (and usually background), so they sort after everything else:
+			item.depth = std::numeric_limits< float >::infinity();
+		}
+
+		if (sort_front_to_back) ::sort_front_to_back(&view.items);
+	}
+}
+
+void Scene::draw_views(std::vector< View > const &views, glm::uvec2 const &drawable_size) {
+	GLint old_viewport[4];
+	glGetIntegerv(GL_VIEWPORT, old_viewport);
+
+	DrawStats total;
+	for (auto const &view : views) {
+		glm::ivec2 min = glm::ivec2(glm::round(view.min * glm::vec2(drawable_size)));
+		glm::ivec2 max = glm::ivec2(glm::round(view.max * glm::vec2(drawable_size)));
+		glm::ivec2 size = glm::max(max - min, glm::ivec2(1));
+		glViewport(min.x, min.y, size.x, size.y);
+		if (view.clear_depth) {
+			glEnable(GL_SCISSOR_TEST);
+			glScissor(min.x, min.y, size.x, size.y);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			glDisable(GL_SCISSOR_TEST);
+		}
+
+		float aspect = size.x / float(size.y);
+		draw_items(glm::infinitePerspective(view.fovy, aspect, view.near) * view.world_to_camera, view.items);
+
+		total.objects += draw_stats.objects;
+		total.draws += draw_stats.draws;
+		total.triangles += draw_stats.triangles;
+		total.prepass_draws += draw_stats.prepass_draws;
+	}
+	draw_stats = total;
+
+	glViewport(old_viewport[0], old_viewport[1], old_viewport[2], old_viewport[3]);
+}
+
+void Scene::gather_draw_items(Scene::Camera const *camera, std::vector< DrawItem > *items) {
+	assert(camera && "Must have a camera to gather draw items for.");
+	assert(items);
+
+	std::vector< View > views(1);
+	views[0].camera = camera;
+	views[0].cull = false;
+	gather_views(&views);
+	items->insert(items->end(), views[0].items.begin(), views[0].items.end());
 }
 
 void Scene::draw(Scene::Camera const *camera) {
 	assert(camera && "Must have a camera to draw scene from.");
 
-	glm::mat4 world_to_camera = camera->transform->make_world_to_local();
-	glm::mat4 world_to_clip = camera->make_projection() * world_to_camera;
+	update_transforms(update_pool);
+
+	std::vector< DrawItem > items;
+	gather_draw_items(camera, &items);
+	draw_items(camera->make_projection() * camera->transform->make_world_to_local(), items);
+}
 
-	for (Scene::Object *object = first_object; object != nullptr; object = object->alloc_next) {
-		glm::mat4 local_to_world = object->transform->make_local_to_world();
+void Scene::extract(RenderSnapshot *snapshot) {
+	assert(snapshot);
+
+	update_transforms(update_pool);
+	gather_views(&snapshot->views);
+}
+
+void Scene::draw(RenderSnapshot const &snapshot, glm::uvec2 const &drawable_size) {
+	draw_views(snapshot.views, drawable_size);
+}
+
+//issue the draw call for an item (indexed or not):
+static void draw_range(Scene::DrawItem const &item) {
+	if (item.index_type == 0) {
+		glDrawArrays(GL_TRIANGLES, item.start, item.count);
+	} else {
+		GLsizei index_size = (item.index_type == GL_UNSIGNED_SHORT ? 2 : (item.index_type == GL_UNSIGNED_BYTE ? 1 : 4));
+		glDrawElements(GL_TRIANGLES, item.count, item.index_type, (GLbyte const *)0 + item.start * index_size);
+	}
+}
+
+void Scene::draw_items(glm::mat4 const &world_to_clip, std::vector< DrawItem > const &items) {
+
+	MatrixStream &stream = matrix_stream;
+	if (stream.stride == 0) {
+		GLint alignment = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		if (alignment < 1) alignment = 1;
+		stream.stride = (GLsizeiptr(sizeof(ObjectMatrices)) + alignment - 1) / alignment * alignment;
+	}
+	stream.staging.clear();
+	stream.offsets.clear();
+
+	//make sure items' mesh buffers are resident (reloading any that were evicted) before drawing starts:
+	for (auto const &item : items) {
+		if (item.mesh_buffer) mesh_residency.use(*item.mesh_buffer);
+	}
+
+	//compute matrices for every item:
+	// (streamed items get a slot in the staging buffer, others keep their matrices for glUniform* calls below)
+	struct Matrices {
+		glm::mat4 mvp;
+		glm::mat4 mv;
+		glm::mat3 itmv;
+	};
+	std::vector< Matrices > uniform_matrices;
+	for (auto const &item : items) {
+		glm::mat4 const &local_to_world = item.local_to_world;
 
 		//compute modelview+projection (object space to clip space) matrix for this object:
 		glm::mat4 mvp = world_to_clip * local_to_world;
@@ -174,39 +1167,152 @@ void Scene::draw(Scene::Camera const *camera) {
 		//compute modelview (object space to camera local space) matrix for this object:
 		glm::mat4 mv = local_to_world;
 
-		//NOTE: inverse cancels out transpose unless there is scale involved
-		glm::mat3 itmv = glm::inverse(glm::transpose(glm::mat3(mv)));
+		//normal matrix (inverse transpose of mv) is cached by update_transforms():
+		glm::mat3 const &itmv = item.normal_to_world;
 
-		//set up program uniforms:
-		glUseProgram(object->program);
-		if (object->program_mvp_mat4 != -1U) {
-			glUniformMatrix4fv(object->program_mvp_mat4, 1, GL_FALSE, glm::value_ptr(mvp));
+		if (item.material->program_matrices_block != -1U) {
+			stream.offsets.emplace_back(GLintptr(stream.staging.size()));
+			stream.staging.resize(stream.staging.size() + stream.stride);
+			ObjectMatrices &om = *reinterpret_cast< ObjectMatrices * >(&stream.staging[stream.offsets.back()]);
+			om.object_to_clip = mvp;
+			for (uint32_t c = 0; c < 4; ++c) om.object_to_light[c] = glm::vec4(glm::vec3(mv[c]), 0.0f);
+			for (uint32_t c = 0; c < 3; ++c) om.normal_to_light[c] = glm::vec4(itmv[c], 0.0f);
+		} else {
+			stream.offsets.emplace_back(-1);
+			uniform_matrices.emplace_back();
+			uniform_matrices.back().mvp = mvp;
+			uniform_matrices.back().mv = mv;
+			uniform_matrices.back().itmv = itmv;
 		}
-		if (object->program_mv_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(object->program_mv_mat4x3, 1, GL_FALSE, glm::value_ptr(mv));
+	}
+
+	//upload all streamed matrices at once:
+	if (!stream.staging.empty()) {
+		GLsizeiptr bytes = GLsizeiptr(stream.staging.size());
+		if (stream.buffer == 0) {
+			glGenBuffers(1, &stream.buffer);
 		}
-		if (object->program_itmv_mat3 != -1U) {
-			glUniformMatrix3fv(object->program_itmv_mat3, 1, GL_FALSE, glm::value_ptr(itmv));
+		glBindBuffer(GL_UNIFORM_BUFFER, stream.buffer);
+		GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+		if (bytes > stream.size) {
+			//(re-)allocate with room for several frames:
+			stream.size = std::max< GLsizeiptr >(bytes * 4, 64 * 1024);
+			glBufferData(GL_UNIFORM_BUFFER, stream.size, NULL, GL_STREAM_DRAW);
+			stream.head = 0;
+		} else if (stream.head + bytes > stream.size) {
+			//ring wrapped: orphan the buffer so the driver can hand back fresh storage without a stall:
+			access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+			stream.head = 0;
+		}
+		void *dst = glMapBufferRange(GL_UNIFORM_BUFFER, stream.head, bytes, access);
+		if (dst) {
+			std::memcpy(dst, stream.staging.data(), stream.staging.size());
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+		} else {
+			std::cerr << "WARNING: failed to map object matrix buffer; falling back to glBufferSubData." << std::endl;
+			glBufferSubData(GL_UNIFORM_BUFFER, stream.head, bytes, stream.staging.data());
 		}
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		for (auto &offset : stream.offsets) {
+			if (offset != -1) offset += stream.head;
+		}
+		stream.head += bytes;
+	}
 
-		if (object->set_uniforms) object->set_uniforms();
+	draw_stats = DrawStats();
+	draw_stats.objects = uint32_t(items.size());
 
-		glBindVertexArray(object->vao);
+	//depth-only pass over opaque, streamed items:
+	bool prepassed = false;
+	if (depth_prepass && depth_prepass_program != 0) {
+		glUseProgram(depth_prepass_program);
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		auto offset = stream.offsets.begin();
+		for (auto const &item : items) {
+			if (*offset != -1 && !item.material->transparent) {
+				glBindBufferRange(GL_UNIFORM_BUFFER, ObjectMatricesBinding, stream.buffer, *offset, sizeof(ObjectMatrices));
+				glBindVertexArray(item.vao);
+				draw_range(item);
+				draw_stats.prepass_draws += 1;
+			}
+			++offset;
+		}
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		//main pass only needs to shade fragments that match the prepass depth:
+		glDepthFunc(GL_LEQUAL);
+		prepassed = true;
+	}
+
+	auto &uploaded_materials = get_uploaded_materials();
+	Scene::Material const *bound = nullptr;
+
+	auto offset = stream.offsets.begin();
+	auto matrices = uniform_matrices.begin();
+	for (auto const &item : items) {
+		Scene::Material *material = item.material;
+
+		//set up program + material parameters (only when they differ from what OpenGL already has):
+		if (material != bound) {
+			glUseProgram(material->program);
+			auto &uploaded = uploaded_materials[material->program];
+			if (uploaded != material || material->uploaded_version != material->version) {
+				material->upload();
+				uploaded = material;
+			}
+			if (material->block_binding != -1U) {
+				glBindBufferBase(GL_UNIFORM_BUFFER, material->block_binding, material->block_buffer);
+			}
+			bound = material;
+		}
+
+		//set up per-item matrices:
+		if (*offset != -1) {
+			glBindBufferRange(GL_UNIFORM_BUFFER, ObjectMatricesBinding, stream.buffer, *offset, sizeof(ObjectMatrices));
+		} else {
+			if (material->program_mvp_mat4 != -1U) {
+				glUniformMatrix4fv(material->program_mvp_mat4, 1, GL_FALSE, glm::value_ptr(matrices->mvp));
+			}
+			if (material->program_mv_mat4x3 != -1U) {
+				glUniformMatrix4x3fv(material->program_mv_mat4x3, 1, GL_FALSE, glm::value_ptr(matrices->mv));
+			}
+			if (material->program_itmv_mat3 != -1U) {
+				glUniformMatrix3fv(material->program_itmv_mat3, 1, GL_FALSE, glm::value_ptr(matrices->itmv));
+			}
+			++matrices;
+		}
+		++offset;
+
+		glBindVertexArray(item.vao);
 
-		//draw the object:
-		glDrawArrays(GL_TRIANGLES, object->start, object->count);
+		//draw the item:
+		draw_range(item);
+
+		draw_stats.draws += 1;
+		draw_stats.triangles += item.count / 3;
+	}
+
+	if (prepassed) {
+		glDepthFunc(GL_LESS);
 	}
 }
 
 
 Scene::~Scene() {
-	while (first_camera) {
-		delete_camera(first_camera);
+	while (!cameras.empty()) {
+		delete_camera(cameras.back());
+	}
+	while (!objects.empty()) {
+		delete_object(objects.back());
+	}
+	while (!materials.empty()) {
+		delete_material(materials.back());
 	}
-	while (first_object) {
-		delete_object(first_object);
+	while (!transforms.empty()) {
+		delete_transform(transforms.back());
 	}
-	while (first_transform) {
-		delete_transform(first_transform);
+	clear_static();
+	if (matrix_stream.buffer != 0) {
+		glDeleteBuffers(1, &matrix_stream.buffer);
+		matrix_stream.buffer = 0;
 	}
 }
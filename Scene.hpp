@@ -1,14 +1,20 @@
 #pragma once
 
 #include "GL.hpp"
+#include "SlotMap.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
 #include <vector>
 #include <list>
+#include <string>
+#include <unordered_map>
 #include <functional>
 
+struct ThreadPool;
+struct MeshBuffer;
+
 //"Scene" manages a hierarchy of transformations with, potentially, attached information.
 struct Scene {
 
@@ -37,6 +43,20 @@ struct Scene {
 		glm::mat4 make_local_to_world() const;
 		glm::mat4 make_world_to_local() const;
 
+		//cached result of make_local_to_world(), computed by Scene::update_transforms():
+		glm::mat4 local_to_world = glm::mat4(1.0f);
+		//cached inverse transpose of local_to_world's upper 3x3 (transforms normals to world space):
+		glm::mat3 normal_to_world = glm::mat3(1.0f);
+		bool uniform_scale = true; //local_to_world scales equally along every axis
+
+		//update_transforms() only recomputes the cache when these differ from the current position/rotation/scale,
+		// when 'dirty' is set (by set_parent), or when an ancestor was recomputed:
+		glm::vec3 cached_position = glm::vec3(0.0f);
+		glm::quat cached_rotation = glm::quat(0.0f, 0.0f, 0.0f, 1.0f);
+		glm::vec3 cached_scale = glm::vec3(1.0f);
+		bool dirty = true;
+		uint32_t recomputed_in = 0; //Scene::update_count of the update that last recomputed the cache
+
 		//constructor/destructor:
 		Transform() = default;
 		Transform(Transform &) = delete;
@@ -48,10 +68,51 @@ struct Scene {
 				set_parent(nullptr);
 			}
 		}
+	};
+
+	//"Material"s contain the program and parameters used to render objects:
+	// (materials are shared between objects and only uploaded to OpenGL when they change)
+	struct Material {
+		//program info:
+		GLuint program = 0;
+		GLuint program_mvp_mat4 = -1U; //uniform index for object-to-clip matrix (mat4)
+		GLuint program_mv_mat4x3 = -1U; //uniform index for model-to-lighting-space matrix (mat4x3)
+		GLuint program_itmv_mat3 = -1U; //uniform index for normal-to-lighting-space matrix (mat3)
+		GLuint program_matrices_block = -1U; //uniform block index for an ObjectMatrices block (see below)
+		//NOTE: if program_matrices_block is set, matrices are streamed through Scene's uniform buffer instead of the uniforms above
 
-		//used by Scene to manage allocation:
-		Transform **alloc_prev_next = nullptr;
-		Transform *alloc_next = nullptr;
+		//transparent materials are drawn after opaque ones, in gather order, and are left out of the depth prepass:
+		bool transparent = false;
+
+		//material parameters (e.g. glossiness); setting a uniform to location -1U is ignored:
+		void set_uniform(GLuint location, float value);
+		void set_uniform(GLuint location, glm::vec2 const &value);
+		void set_uniform(GLuint location, glm::vec3 const &value);
+		void set_uniform(GLuint location, glm::vec4 const &value);
+		void set_uniform(GLuint location, glm::mat4 const &value);
+		void set_uniform(GLuint location, GLint value);
+
+		//uniform block data, uploaded to a buffer bound at 'binding' (GL_UNIFORM_BUFFER) when the material is used:
+		void set_block(GLuint binding, void const *data, size_t size);
+
+		//send parameters to OpenGL (program must be in use); called by Scene::draw when needed:
+		void upload();
+
+		//internals:
+		struct Uniform {
+			GLuint location = -1U;
+			GLenum type = 0;
+			uint32_t offset = 0; //offset of value in 'values'
+		};
+		std::vector< Uniform > uniforms;
+		std::vector< GLfloat > values; //(GLint values are stored bitwise)
+		GLuint block_binding = -1U;
+		std::vector< char > block_data;
+		GLuint block_buffer = 0;
+		uint32_t version = 1; //incremented whenever parameters change
+		uint32_t uploaded_version = 0; //version most recently sent to OpenGL
+
+		~Material();
 	};
 
 	//"Object"s contain information needed to render meshes:
@@ -61,23 +122,41 @@ struct Scene {
 			assert(transform);
 		}
 
-		//program info:
-		GLuint program = 0;
-		GLuint program_mvp_mat4 = -1U; //uniform index for object-to-clip matrix (mat4)
-		GLuint program_mv_mat4x3 = -1U; //uniform index for model-to-lighting-space matrix (mat4x3)
-		GLuint program_itmv_mat3 = -1U; //uniform index for normal-to-lighting-space matrix (mat3)
-
 		//material info:
-		std::function< void() > set_uniforms; //will be called before rendering object, use to set material parameters (e.g. glossiness)
+		Material *material = nullptr; //objects must have a material to be drawn; materials may be shared between objects.
 
 		//attribute info:
 		GLuint vao = 0;
 		GLuint start = 0;
 		GLuint count = 0;
+		//if not zero, start/count are a range of indices of this type in the element buffer bound in vao (e.g. MeshBuffer::index_type):
+		GLenum index_type = 0;
+		//stored positions are decoded as position_scale * Position + position_bias (e.g. MeshBuffer::Mesh for quantized formats):
+		glm::vec3 position_scale = glm::vec3(1.0f);
+		glm::vec3 position_bias = glm::vec3(0.0f);
+
+		//level-of-detail info (optional):
+		// if not empty, Scene::draw picks one of these levels (finest first) instead of using start/count:
+		struct LOD {
+			GLuint start = 0;
+			GLuint count = 0;
+			glm::vec3 position_scale = glm::vec3(1.0f);
+			glm::vec3 position_bias = glm::vec3(0.0f);
+		};
+		std::vector< LOD > lods;
+		glm::vec3 lod_center = glm::vec3(0.0f); //bounding sphere (object space) used to estimate projected size
+		float lod_radius = 0.0f; //(also used for view culling; zero means the object is never culled)
+		uint32_t lod = 0; //level drawn most recently (used for hysteresis)
 
-		//used by Scene to manage allocation:
-		Object **alloc_prev_next = nullptr;
-		Object *alloc_next = nullptr;
+		//static geometry (optional):
+		// objects marked is_static are merged into world-space buffers by Scene::bake_static()
+		bool is_static = false;
+		MeshBuffer const *mesh_buffer = nullptr; //buffer that vao/start/count refer to (required to bake; also keeps the buffer resident while drawn)
+		bool baked = false; //set by bake_static(); baked objects are drawn as part of a StaticBatch
+
+		//used by Scene to track the object in its proximity grid:
+		uint64_t grid_cell = 0;
+		uint32_t grid_slot = -1U; //index in grid cell's list (or -1U if not in grid)
 	};
 
 	//"Camera"s contain information needed to view a scene:
@@ -95,10 +174,6 @@ struct Scene {
 		float distance = 10.0f;
 		//computed from the above:
 		glm::mat4 make_projection() const;
-
-		//used by Scene to manage allocation:
-		Camera **alloc_prev_next = nullptr;
-		Camera *alloc_next = nullptr;
 	};
 
 	//------ functions to create / destroy scene things -----
@@ -114,23 +189,261 @@ struct Scene {
 	//Delete an object:
 	void delete_object(Object *);
 
+	//Create a new material:
+	Material *new_material();
+	//Delete a material: (NOTE: it is an error to delete a material still used by an Object)
+	void delete_material(Material *);
+
 	//Create a new camera attached to a transform:
 	Camera *new_camera(Transform *transform);
 	//Delete a camera:
 	void delete_camera(Camera *);
 
-	//used to manage allocated objects:
-	Transform *first_transform = nullptr;
-	Object *first_object = nullptr;
-	Camera *first_camera = nullptr;
-	//(you shouldn't be manipulating these pointers directly
+	//Scene things are stored in slot maps: pointers remain valid until the thing is deleted,
+	// and deleted things' storage is reused by later allocations.
+	SlotMap< Transform > transforms;
+	SlotMap< Object > objects;
+	SlotMap< Material > materials;
+	SlotMap< Camera > cameras;
+	//(you shouldn't be creating or erasing things through these directly; iterating over them is fine)
+
+	//------ handles ------
+	//Handles are 32-bit references to scene things that detect use-after-delete:
+	// get() returns nullptr for a handle whose thing has been deleted (even if its storage was reused).
+	typedef SlotMap< Transform >::Handle TransformHandle;
+	typedef SlotMap< Object >::Handle ObjectHandle;
+	typedef SlotMap< Material >::Handle MaterialHandle;
+	typedef SlotMap< Camera >::Handle CameraHandle;
+
+	TransformHandle handle(Transform const *transform) const { return transforms.handle(transform); }
+	ObjectHandle handle(Object const *object) const { return objects.handle(object); }
+	MaterialHandle handle(Material const *material) const { return materials.handle(material); }
+	CameraHandle handle(Camera const *camera) const { return cameras.handle(camera); }
+
+	Transform *get(TransformHandle h) const { return transforms.get(h); }
+	Object *get(ObjectHandle h) const { return objects.get(h); }
+	Material *get(MaterialHandle h) const { return materials.get(h); }
+	Camera *get(CameraHandle h) const { return cameras.get(h); }
+
+	//Delete through a handle; returns false (and does nothing) if the handle is stale:
+	bool delete_transform(TransformHandle h);
+	bool delete_object(ObjectHandle h);
+	bool delete_material(MaterialHandle h);
+	bool delete_camera(CameraHandle h);
+
+	//------ functions to load scene content ------
+
+	//Add the transforms, objects, and cameras stored in a '.scene' file (as written by meshes/export-scene.py):
+	// 'on_object' is called for every mesh reference with the transform it is attached to and the mesh name;
+	//  it is responsible for creating (or not) an Object and setting its material, vao, start, and count.
+	// note: will throw if file fails to read.
+	void load(std::string const &filename,
+		std::function< void(Scene &, Transform *, std::string const &) > const &on_object = nullptr);
+
+	//------ snapshots ------
+
+	//A Snapshot is a compact binary copy of the scene's transforms (including hierarchy), object bindings (including LOD levels and static flags), and cameras:
+	// (materials are not copied; objects record which of the scene's materials they use)
+	struct Snapshot {
+		std::vector< char > data;
+	};
+
+	//Record the current state of the scene:
+	void save(Snapshot *snapshot) const;
+
+	//Return the scene to a saved state:
+	// if the scene still has the same number of transforms/objects/cameras/materials as when it was saved,
+	//  values are copied back into the existing things (so pointers to them remain valid);
+	// otherwise, all transforms/objects/cameras are deleted and re-created from the snapshot.
+	void restore(Snapshot const &snapshot);
+
+	//------ proximity queries ------
+
+	//Objects are filed by world position (the origin of their transform) into a uniform grid of cubical cells,
+	// stored sparsely in a hash table. update_transforms() re-files objects whose cell has changed.
+	struct Grid {
+		float cell_size = 2.0f; //(call clear_grid() after changing)
+		std::unordered_map< uint64_t, std::vector< Object * > > cells;
+	} grid;
+
+	//re-file objects whose cell changed in the most recent update_transforms() (which calls this):
+	// only objects whose transforms that update recomputed (or that aren't in the grid yet) are looked at.
+	void update_grid();
+	//remove all objects from the grid (they will be re-added on the next update_grid()):
+	void clear_grid();
+
+	//Append objects within 'radius' of 'center' to 'out':
+	// (positions are as of the most recent update_transforms(), so call it first if transforms have moved since;
+	//  cost depends only on the number of objects in nearby cells)
+	void query_radius(glm::vec3 const &center, float radius, std::vector< Object * > *out) const;
+	//Append objects inside the box [min,max] to 'out':
+	void query_box(glm::vec3 const &min, glm::vec3 const &max, std::vector< Object * > *out) const;
 
 	//------ functions to traverse the scene ------
 
+	//Compute the local_to_world matrix of every transform in one pass over the hierarchy, then update the grid:
+	// if 'pool' is given, each root's subtree is a separate work item spread across the pool's threads.
+	void update_transforms(ThreadPool *pool = nullptr);
+
+	//if set, draw() uses this pool to update transforms:
+	ThreadPool *update_pool = nullptr;
+
+	//number of update_transforms() calls so far (see Transform::recomputed_in):
+	uint32_t update_count = 0;
+
+	//Counts from the most recent update_transforms():
+	struct UpdateStats {
+		uint32_t transforms = 0;
+		uint32_t recomputed = 0; //transforms whose cached matrices changed
+	} update_stats;
+
+	//Level-of-detail selection:
+	// objects switch from level i to level i+1 when their bounding sphere's projected diameter
+	// falls below (lod_threshold * 0.5^i) of the viewport height, and switch back when it
+	// rises above that size; lod_hysteresis widens the gap between the two to avoid flickering.
+	float lod_threshold = 0.25f;
+	float lod_hysteresis = 0.1f;
+
+	//------ static geometry ------
+
+	//bake_static() merges the vertices of all is_static objects that share a material and mesh buffer into one
+	// world-space vertex buffer, which is drawn with a single call and a single (identity) model matrix:
+	// (baked objects that move afterward won't be drawn in their new position until the next bake_static())
+	struct StaticBatch {
+		Material *material = nullptr;
+		GLuint vbo = 0;
+		GLuint ibo = 0; //(GL_UNSIGNED_INT indices)
+		GLuint vao = 0;
+		GLuint count = 0; //number of indices
+		//world positions are position_scale * Position + position_bias (not the identity if the source buffer is quantized):
+		glm::vec3 position_scale = glm::vec3(1.0f);
+		glm::vec3 position_bias = glm::vec3(0.0f);
+	};
+	std::vector< StaticBatch > static_batches;
+
+	void bake_static();
+	//free all static batches (objects are drawn individually again):
+	void clear_static();
+
+	//------ drawing ------
+
+	//A DrawItem is a single draw call:
+	struct DrawItem {
+		Material *material = nullptr;
+		GLuint vao = 0;
+		MeshBuffer const *mesh_buffer = nullptr; //(as in Object; if set, draw_items() keeps it resident, see MeshResidency.hpp)
+		GLuint start = 0;
+		GLuint count = 0;
+		GLenum index_type = 0; //(as in Object)
+		glm::mat4 local_to_world = glm::mat4(1.0f);
+		glm::mat3 normal_to_world = glm::mat3(1.0f);
+		float depth = 0.0f; //view depth of item's center (used for sorting)
+	};
+
+	//Draw ordering options:
+	// sort_front_to_back draws opaque items nearest-first (so hidden fragments fail the depth test early);
+	// depth_prepass first draws opaque items with depth_prepass_program (depth only, e.g. DepthProgram),
+	//  then draws them again with their materials, shading only the visible fragments.
+	//  (only items whose materials stream ObjectMatrices are prepassed; their programs must put Position at location 0)
+	bool sort_front_to_back = false;
+	bool depth_prepass = false;
+	GLuint depth_prepass_program = 0; //depth prepass is skipped if this is zero
+
+	//A View is a camera drawn into a rectangle of the drawable (e.g. one half of a split screen, or a minimap):
+	struct View {
+		//set up by caller:
+		Camera const *camera = nullptr;
+		glm::vec2 min = glm::vec2(0.0f); //lower left of viewport, as a fraction of drawable size
+		glm::vec2 max = glm::vec2(1.0f); //upper right of viewport, as a fraction of drawable size
+		float aspect = 1.0f; //viewport width / height in pixels (used for culling; drawing uses the actual viewport)
+		bool cull = true; //skip objects whose bounding spheres are outside the view
+		bool clear_depth = false; //clear depth inside the viewport before drawing (for views drawn over others)
+
+		//filled by gather_views (copied from camera, so the view can still be drawn after the camera changes):
+		glm::mat4 world_to_camera = glm::mat4(1.0f);
+		float fovy = glm::radians(60.0f);
+		float near = 0.01f;
+		std::vector< DrawItem > items; //this view's draw list
+	};
+
+	//Build the draw lists for several views in one pass over the objects:
+	// each object's bounds are tested against every view, its level of detail is picked once
+	// (from the view it appears largest in), and it is appended to the lists of the views that can see it.
+	// (assumes update_transforms() has been called)
+	void gather_views(std::vector< View > *views);
+
+	//Draw views gathered by gather_views, each in its own viewport:
+	void draw_views(std::vector< View > const &views, glm::uvec2 const &drawable_size);
+
+	//Collect the draw items for a camera's view (objects at their selected level of detail, then static batches):
+	// (assumes update_transforms() has been called; doesn't cull, since the camera's aspect may be out of date)
+	void gather_draw_items(Camera const *camera, std::vector< DrawItem > *items);
+
+	//Compute matrices for a list of draw items and send them to OpenGL:
+	void draw_items(glm::mat4 const &world_to_clip, std::vector< DrawItem > const &items);
+
+	//A RenderSnapshot is a self-contained copy of what is needed to draw the scene from a set of views;
+	// it can be drawn while the scene keeps changing (e.g. on the render thread while the next update runs).
+	// NOTE: materials are referenced, not copied, so they should not be changed while a snapshot is being drawn.
+	struct RenderSnapshot {
+		std::vector< View > views; //(caller sets up camera, viewport, and aspect for each view)
+	};
+
+	//Fill the draw lists of a snapshot's views (calls update_transforms() and gather_views()):
+	void extract(RenderSnapshot *snapshot);
+
+	//Draw a snapshot:
+	// reads the snapshot and the depth prepass settings, but not transforms, objects, cameras, or static batches,
+	// so those may be changed (e.g. by update() and extract() on another thread) while it runs. It does write:
+	//  - matrix_stream and draw_stats;
+	//  - the materials in the snapshot (Material::upload() sets uploaded_version and creates block_buffer), and
+	//    the (file-static) record of which material each program last uploaded, which delete_material() also changes;
+	//  - mesh_residency (which may reload evicted mesh buffers; see MeshResidency.hpp);
+	// so none of those may be used by another thread while it runs.
+	void draw(RenderSnapshot const &snapshot, glm::uvec2 const &drawable_size);
+
+	//Counts from the most recent draw():
+	struct DrawStats {
+		uint32_t objects = 0;
+		uint32_t draws = 0;
+		uint64_t triangles = 0;
+		uint32_t prepass_draws = 0;
+	} draw_stats;
+
 	//Draw the scene from a given camera by computing appropriate matrices and sending all objects to OpenGL:
+	// (calls update_transforms(), gather_draw_items(), and draw_items())
 	//"camera" must be non-null!
 	void draw(Camera const *camera);
 
+	//------ per-object matrix streaming ------
+
+	//Layout (std140) of the per-object uniform block used by materials with program_matrices_block set:
+	// layout(std140) uniform ObjectMatrices {
+	//     mat4 object_to_clip;
+	//     mat4x3 object_to_light;
+	//     mat3 normal_to_light;
+	// };
+	struct ObjectMatrices {
+		glm::mat4 object_to_clip;
+		glm::vec4 object_to_light[4]; //std140 mat4x3: four columns, each padded to vec4
+		glm::vec4 normal_to_light[3]; //std140 mat3: three columns, each padded to vec4
+	};
+	static_assert(sizeof(ObjectMatrices) == 16*4 + 4*4*4 + 3*4*4, "ObjectMatrices matches std140 layout");
+
+	//programs using ObjectMatrices should bind the block to this binding point (glUniformBlockBinding):
+	static constexpr GLuint ObjectMatricesBinding = 0;
+
+	//Each frame's matrices are written to the next free region of a ring in a single uniform buffer;
+	// the buffer is orphaned (and writing restarts at zero) only when the ring wraps:
+	struct MatrixStream {
+		GLuint buffer = 0;
+		GLsizeiptr size = 0; //allocated size of buffer
+		GLsizeiptr head = 0; //next free byte in buffer
+		GLsizeiptr stride = 0; //sizeof(ObjectMatrices) rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+		std::vector< char > staging; //this frame's matrices, uploaded with one map/unmap
+		std::vector< GLintptr > offsets; //per-object offsets into buffer for this frame (-1 if not streamed)
+	} matrix_stream;
+
 
-	~Scene(); //destructor deallocates transforms, objects, cameras
+	~Scene(); //destructor deallocates transforms, objects, materials, cameras
 };
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//A Handle is a 32-bit reference to an item in a SlotMap:
+// the low bits are the item's slot index and the high bits are the slot's generation when the handle was made,
+// so a handle to a deleted item (even if its slot has been reused) can be detected.
+//Handle{} (value zero) is never a valid handle.
+template< typename T >
+struct Handle {
+	static constexpr uint32_t IndexBits = 20;
+	static constexpr uint32_t IndexMask = (1U << IndexBits) - 1U;
+	static constexpr uint32_t GenerationMask = (1U << (32U - IndexBits)) - 1U;
+
+	uint32_t value = 0;
+
+	Handle() = default;
+	Handle(uint32_t index, uint32_t generation) : value((generation << IndexBits) | index) {
+		assert(index <= IndexMask);
+		assert(generation != 0 && generation <= GenerationMask);
+	}
+
+	uint32_t index() const { return value & IndexMask; }
+	uint32_t generation() const { return value >> IndexBits; }
+
+	explicit operator bool() const { return value != 0; }
+	bool operator==(Handle const &other) const { return value == other.value; }
+	bool operator!=(Handle const &other) const { return value != other.value; }
+};
+
+//A SlotMap owns items of type T:
+// - items live in fixed-size chunks of slots, so pointers to them stay valid until they are erased,
+//   and the slots of erased items are reused (no per-item heap allocation);
+// - live items are also listed in a dense array, so iteration doesn't visit empty slots;
+// - create and erase are O(1) (erase swaps the last item in the dense array into the erased item's place).
+template< typename T >
+struct SlotMap {
+	typedef ::Handle< T > Handle;
+
+	SlotMap() = default;
+	SlotMap(SlotMap const &) = delete;
+	SlotMap &operator=(SlotMap const &) = delete;
+	~SlotMap() {
+		while (!items.empty()) erase(items.back());
+	}
+
+	template< typename... Args >
+	T *create(Args&&... args) {
+		uint32_t index;
+		if (first_free != -1U) {
+			index = first_free;
+			first_free = slot(index).next_free;
+		} else {
+			index = slot_count;
+			assert(index <= Handle::IndexMask && "SlotMap is out of handle indices.");
+			if (index / ChunkSize == chunks.size()) chunks.emplace_back(new Slot[ChunkSize]); //(unless reserved)
+			slot_count += 1;
+		}
+		Slot &s = slot(index);
+		T *t = new (&s.storage) T(std::forward< Args >(args)...); //"perfect forwarding"
+		s.index = index;
+		s.dense = uint32_t(items.size());
+		items.emplace_back(t);
+		return t;
+	}
+
+	void erase(T *t) {
+		assert(t && "It is invalid to erase a null item.");
+		Slot &s = slot_of(t);
+		assert(s.dense < items.size() && items[s.dense] == t && "Item must be live in this SlotMap.");
+
+		//swap the last live item into this item's place in the dense list:
+		items[s.dense] = items.back();
+		slot_of(items[s.dense]).dense = s.dense;
+		items.pop_back();
+
+		t->~T();
+
+		//bump the generation so existing handles become stale (generation zero is reserved for null handles):
+		s.generation = (s.generation + 1) & Handle::GenerationMask;
+		if (s.generation == 0) s.generation = 1;
+		s.dense = -1U;
+		s.next_free = first_free;
+		first_free = s.index;
+	}
+
+	Handle handle(T const *t) const {
+		if (!t) return Handle();
+		Slot const &s = slot_of(t);
+		assert(s.dense < items.size() && items[s.dense] == t && "Item must be live in this SlotMap.");
+		return Handle(s.index, s.generation);
+	}
+
+	//returns nullptr if the handle is null or refers to an item that has been erased:
+	T *get(Handle h) const {
+		if (!h || h.index() >= slot_count) return nullptr;
+		Slot const &s = slot(h.index());
+		if (s.dense == -1U || s.generation != h.generation()) return nullptr;
+		return items[s.dense];
+	}
+
+	//allocate storage for 'count' more items up front, so creating them doesn't allocate:
+	void reserve(size_t count) {
+		items.reserve(items.size() + count);
+		size_t slots = size_t(slot_count) + count;
+		chunks.reserve((slots + ChunkSize - 1) / ChunkSize);
+		while (chunks.size() * ChunkSize < slots) chunks.emplace_back(new Slot[ChunkSize]);
+	}
+
+	//live items (order changes when items are erased):
+	std::vector< T * > const &all() const { return items; }
+	typename std::vector< T * >::const_iterator begin() const { return items.begin(); }
+	typename std::vector< T * >::const_iterator end() const { return items.end(); }
+	size_t size() const { return items.size(); }
+	bool empty() const { return items.empty(); }
+	T *back() const { return items.back(); }
+
+	//internals:
+	static constexpr uint32_t ChunkSize = 256;
+	struct Slot {
+		typename std::aligned_storage< sizeof(T), alignof(T) >::type storage; //must be first (see slot_of)
+		uint32_t index = 0; //this slot's index
+		uint32_t generation = 1;
+		uint32_t dense = -1U; //index in 'items' (or -1U if slot is free)
+		uint32_t next_free = -1U;
+	};
+	static_assert(std::is_standard_layout< Slot >::value, "Slot must be standard layout so items can be mapped to their slots.");
+
+	Slot &slot(uint32_t index) const { return chunks[index / ChunkSize][index % ChunkSize]; }
+	static Slot &slot_of(T const *t) { return *reinterpret_cast< Slot * >(const_cast< T * >(t)); }
+
+	std::vector< std::unique_ptr< Slot[] > > chunks;
+	uint32_t slot_count = 0;
+	uint32_t first_free = -1U;
+	std::vector< T * > items;
+};
@@ -31,6 +31,9 @@ struct Sample {
 		LoopOrOnce loop_or_once = Once
 	) const;
 
+	//memory used by the sample's data (see AssetRegistry):
+	size_t bytes() const { return data.size() * sizeof(float); }
+
 	std::vector< float > data;
 };
 
@@ -0,0 +1,104 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+ThreadPool::ThreadPool(uint32_t count) : job(nullptr), remaining(0) {
+	if (count == 0) count = std::max(1U, std::thread::hardware_concurrency());
+	for (uint32_t i = 0; i < count; ++i) {
+		queues.emplace_back(new Queue);
+	}
+	for (uint32_t i = 1; i < count; ++i) {
+		threads.emplace_back(&ThreadPool::worker, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+}
+
+void ThreadPool::parallel_for(uint32_t count, std::function< void(uint32_t) > const &fn) {
+	if (count == 0) return;
+	if (queues.size() == 1 || count == 1) {
+		for (uint32_t i = 0; i < count; ++i) fn(i);
+		return;
+	}
+
+	assert(remaining == 0 && "parallel_for is not re-entrant.");
+	job = &fn;
+	remaining = count;
+
+	//deal out contiguous runs of items so that neighbors tend to stay on the same thread:
+	uint32_t per_queue = (count + uint32_t(queues.size()) - 1) / uint32_t(queues.size());
+	for (uint32_t q = 0; q < queues.size(); ++q) {
+		std::unique_lock< std::mutex > lock(queues[q]->mutex);
+		for (uint32_t i = q * per_queue; i < std::min(count, (q + 1) * per_queue); ++i) {
+			queues[q]->items.emplace_back(i);
+		}
+	}
+
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		generation += 1;
+	}
+	wake.notify_all();
+
+	//help out until there is nothing left to steal:
+	while (run_one(0)) { }
+
+	//wait for items still running on other threads:
+	std::unique_lock< std::mutex > lock(mutex);
+	done.wait(lock, [this](){ return remaining == 0; });
+	job = nullptr;
+}
+
+bool ThreadPool::run_one(uint32_t self) {
+	uint32_t item = -1U;
+	//own queue first (from the back, which is most likely to be in cache)...
+	{
+		Queue &queue = *queues[self];
+		std::unique_lock< std::mutex > lock(queue.mutex);
+		if (!queue.items.empty()) {
+			item = queue.items.back();
+			queue.items.pop_back();
+		}
+	}
+	//...then steal from the front of the other queues:
+	for (uint32_t offset = 1; item == -1U && offset < queues.size(); ++offset) {
+		Queue &queue = *queues[(self + offset) % queues.size()];
+		std::unique_lock< std::mutex > lock(queue.mutex);
+		if (!queue.items.empty()) {
+			item = queue.items.front();
+			queue.items.pop_front();
+		}
+	}
+	if (item == -1U) return false;
+
+	(*job.load())(item);
+
+	if (remaining.fetch_sub(1) == 1) {
+		std::unique_lock< std::mutex > lock(mutex);
+		done.notify_all();
+	}
+	return true;
+}
+
+void ThreadPool::worker(uint32_t self) {
+	uint32_t seen = 0;
+	while (true) {
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			wake.wait(lock, [&](){ return quit || generation != seen; });
+			if (quit) return;
+			seen = generation;
+		}
+		while (run_one(self)) { }
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//"ThreadPool" runs batches of independent work items across a fixed set of worker threads.
+// Each worker (including the thread calling parallel_for) owns a queue of item indices;
+// workers that run out of items steal from the front of other workers' queues,
+// so unevenly-sized items (e.g. transform subtrees) still balance across threads.
+
+struct ThreadPool {
+	//'threads' is the total number of threads to use, including the calling thread:
+	// (0 means one per hardware thread)
+	explicit ThreadPool(uint32_t threads = 0);
+	~ThreadPool();
+
+	ThreadPool(ThreadPool const &) = delete;
+	ThreadPool &operator=(ThreadPool const &) = delete;
+
+	//call fn(i) for every i in [0,count), returning once all calls have finished:
+	// (the calling thread works on items as well; fn must be safe to call concurrently)
+	void parallel_for(uint32_t count, std::function< void(uint32_t) > const &fn);
+
+	//number of threads that work on a parallel_for (including the caller):
+	uint32_t size() const { return uint32_t(queues.size()); }
+
+	//internals:
+	struct Queue {
+		std::mutex mutex;
+		std::deque< uint32_t > items;
+	};
+	std::vector< std::unique_ptr< Queue > > queues; //queues[0] belongs to the calling thread
+	std::vector< std::thread > threads; //threads[i] services queues[i+1]
+
+	std::atomic< std::function< void(uint32_t) > const * > job; //function for the items currently queued
+	std::atomic< uint32_t > remaining; //items queued or running
+
+	std::mutex mutex; //guards 'generation' + 'quit'
+	std::condition_variable wake; //workers wait on this for new items
+	std::condition_variable done; //parallel_for waits on this for 'remaining' to reach zero
+	uint32_t generation = 0;
+	bool quit = false;
+
+	bool run_one(uint32_t self); //run one item from own queue or steal one; returns false if no items were found
+	void worker(uint32_t self);
+};
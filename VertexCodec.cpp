@@ -0,0 +1,117 @@
+#include "VertexCodec.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+//unpack 16 values of 'Bits' bits each, then replace escaped values (all bits set) with literal bytes:
+template< uint32_t Bits >
+static char const *decode_group(char const *at, char const *end, uint8_t *out) {
+	static const uint32_t Packed = 16 * Bits / 8;
+	static const uint8_t Escape = (1 << Bits) - 1;
+	if (size_t(end - at) < Packed) {
+		throw std::runtime_error("Compressed vertex data is truncated.");
+	}
+	uint8_t const *packed = reinterpret_cast< uint8_t const * >(at);
+	for (uint32_t j = 0; j < 16; ++j) {
+		out[j] = (packed[(j * Bits) / 8] >> ((j * Bits) % 8)) & Escape;
+	}
+	at += Packed;
+	uint32_t escapes = 0;
+	for (uint32_t j = 0; j < 16; ++j) {
+		escapes += (out[j] == Escape);
+	}
+	if (escapes == 0) return at;
+	if (size_t(end - at) < escapes) {
+		throw std::runtime_error("Compressed vertex data is truncated.");
+	}
+	//(branch-free: the i'th escaped value takes the i'th literal)
+	uint8_t const *literals = reinterpret_cast< uint8_t const * >(at);
+	uint32_t next = 0;
+	for (uint32_t j = 0; j < 16; ++j) {
+		uint32_t escaped = (out[j] == Escape);
+		uint8_t literal = literals[std::min(next, escapes - 1)];
+		out[j] = escaped ? literal : out[j];
+		next += escaped;
+	}
+	return at + escapes;
+}
+
+//read one byte stream (groups * 16 zigzag-encoded deltas) of a block:
+static char const *decode_stream(char const *at, char const *end, uint32_t groups, uint8_t *out) {
+	uint32_t header_bytes = (groups + 3) / 4;
+	if (size_t(end - at) < header_bytes) {
+		throw std::runtime_error("Compressed vertex data is truncated.");
+	}
+	uint8_t const *modes = reinterpret_cast< uint8_t const * >(at);
+	at += header_bytes;
+	for (uint32_t g = 0; g < groups; ++g) {
+		uint32_t mode = (modes[g / 4] >> (2 * (g % 4))) & 3;
+		uint8_t *group = out + 16 * g;
+		if (mode == 0) {
+			std::memset(group, 0, 16);
+		} else if (mode == 1) {
+			at = decode_group< 2 >(at, end, group);
+		} else if (mode == 2) {
+			at = decode_group< 4 >(at, end, group);
+		} else {
+			if (size_t(end - at) < 16) throw std::runtime_error("Compressed vertex data is truncated.");
+			std::memcpy(group, at, 16);
+			at += 16;
+		}
+	}
+	return at;
+}
+
+//add each vertex's deltas (stored a stream at a time, VertexCodecBlock bytes apart) to the previous vertex:
+// (with a fixed Stride, the running vertex stays in registers; used for common strides)
+template< size_t Stride >
+static void undo_deltas(uint8_t const *deltas, size_t vertices, uint8_t *previous, char *out) {
+	uint8_t value[Stride];
+	std::memcpy(value, previous, Stride);
+	for (size_t i = 0; i < vertices; ++i) {
+		for (size_t k = 0; k < Stride; ++k) {
+			value[k] += deltas[k * VertexCodecBlock + i];
+		}
+		std::memcpy(out + i * Stride, value, Stride);
+	}
+	std::memcpy(previous, value, Stride);
+}
+
+void decode_vertices(char const *begin, char const *end, size_t count, size_t stride, char *out) {
+	if (stride == 0) throw std::runtime_error("Compressed vertices must have a non-zero stride.");
+
+	char const *at = begin;
+	std::vector< uint8_t > previous(stride, 0); //the last vertex decoded
+	std::vector< uint8_t > deltas(stride * VertexCodecBlock); //byte streams of the current block
+	for (size_t block = 0; block < count; block += VertexCodecBlock) {
+		size_t vertices = std::min(VertexCodecBlock, count - block);
+		uint32_t groups = uint32_t((vertices + 15) / 16);
+		for (size_t k = 0; k < stride; ++k) {
+			uint8_t *stream = &deltas[k * VertexCodecBlock];
+			at = decode_stream(at, end, groups, stream);
+			//undo zigzag:
+			for (uint32_t i = 0; i < 16 * groups; ++i) {
+				stream[i] = uint8_t((stream[i] >> 1) ^ -(stream[i] & 1));
+			}
+		}
+		//undo deltas a vertex at a time, writing each vertex to 'out' once:
+		char *vertex = out + block * stride;
+		if (stride == 16) {
+			undo_deltas< 16 >(deltas.data(), vertices, previous.data(), vertex);
+		} else {
+			for (size_t i = 0; i < vertices; ++i) {
+				for (size_t k = 0; k < stride; ++k) {
+					previous[k] += deltas[k * VertexCodecBlock + i];
+				}
+				std::memcpy(vertex, previous.data(), stride);
+				vertex += stride;
+			}
+		}
+	}
+	if (at != end) {
+		throw std::runtime_error("Compressed vertex data has trailing bytes.");
+	}
+}
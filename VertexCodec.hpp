@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+//"VertexCodec" decodes vertex arrays compressed by meshes/cook-meshes.py (in the style of meshoptimizer's vertex codec):
+// vertices are stored in blocks of up to VertexCodecBlock vertices. Within a block, each byte of the vertex
+// is stored as a separate stream of byte-wise deltas from the same byte of the previous vertex (zigzag-encoded,
+// so small changes in either direction become small numbers). Each stream is split into groups of 16 deltas,
+// and each group is packed at the smallest of:
+//  mode 0: all zero (no bytes)
+//  mode 1: 2 bits per delta (4 bytes), then one literal byte for each delta stored as 3
+//  mode 2: 4 bits per delta (8 bytes), then one literal byte for each delta stored as 15
+//  mode 3: 8 bits per delta (16 bytes)
+// a stream starts with the 2-bit modes of its groups (four per byte), followed by the groups.
+//Quantized attributes (e.g. the '.qpnc' layout) of nearby vertices differ in only a few low bits, so most groups pack into modes 0-2.
+//
+//The decoder works a 16-wide group at a time with fixed-size loops (which compilers vectorize), and writes
+// each vertex straight to its final location.
+
+static const size_t VertexCodecBlock = 256; //vertices per block (a multiple of 16)
+
+//decode 'count' vertices of 'stride' bytes from the encoded data [begin,end) into 'out' (which must hold count * stride bytes):
+// note: will throw if the data is malformed (or doesn't hold exactly 'count' vertices).
+void decode_vertices(char const *begin, char const *end, size_t count, size_t stride, char *out);
@@ -1,5 +1,7 @@
 #include "WalkMesh.hpp"
 
+#include "ChunkFile.hpp"
+
 static glm::vec3 triangle_to_world(
     std::vector<glm::vec3> triangle, const glm::vec3 &pos) {
     // I'll be honest this is almost the exact same as the following source:
@@ -97,11 +99,11 @@ glm::vec3 barycentric(glm::vec3 p0, glm::vec3 a, glm::vec3 b, glm::vec3 c) {
 }
 
 WalkMesh::WalkMesh(std::string file){
-	std::ifstream filename(file, std::ios::binary);
+	ChunkFile chunks(file);
 
-	read_chunk(filename, "tri0", &triangles);
-	read_chunk(filename, "vrt0", &vertices);
-	read_chunk(filename, "nrm0", &vertex_normals);
+	chunks.read("tri0", &triangles);
+	chunks.read("vrt0", &vertices);
+	chunks.read("nrm0", &vertex_normals);
 
 	for (auto const &t : triangles) {
         //TODO: construct next_vertex map
@@ -28,6 +28,12 @@ struct WalkMesh {
 	//Construct new WalkMesh and build next_vertex structure:
 	WalkMesh(std::string file);
 
+	//(approximate) memory used by the walk mesh (see AssetRegistry):
+	size_t bytes() const {
+		return vertices.size() * sizeof(glm::vec3) + triangles.size() * sizeof(glm::uvec3) + vertex_normals.size() * sizeof(glm::vec3)
+		     + next_vertex.size() * (sizeof(glm::uvec2) + sizeof(uint32_t));
+	}
+
 	struct WalkPoint {
 		glm::uvec3 triangle = glm::uvec3(-1U); //indices of current triangle
 		glm::vec3 weights = glm::vec3(std::numeric_limits< float >::quiet_NaN()); //barycentric coordinates for current point
@@ -0,0 +1,31 @@
+#include "depth_program.hpp"
+
+#include "compile_program.hpp"
+#include "Scene.hpp"
+
+DepthProgram::DepthProgram() {
+	program = compile_program(
+		"#version 330\n"
+		"layout(std140) uniform ObjectMatrices {\n" //see Scene::ObjectMatrices
+		"	mat4 object_to_clip;\n"
+		"	mat4x3 object_to_light;\n"
+		"	mat3 normal_to_light;\n"
+		"};\n"
+		"layout(location=0) in vec4 Position;\n" //must match the location used by programs drawn in the main pass
+		"invariant gl_Position;\n" //so depth matches the main pass exactly
+		"void main() {\n"
+		"	gl_Position = object_to_clip * Position;\n"
+		"}\n"
+		,
+		"#version 330\n"
+		"void main() {\n"
+		"}\n"
+	);
+
+	object_matrices_block = glGetUniformBlockIndex(program, "ObjectMatrices");
+	glUniformBlockBinding(program, object_matrices_block, Scene::ObjectMatricesBinding);
+}
+
+Load< DepthProgram > depth_program(LoadTagInit, [](){
+	return new DepthProgram();
+});
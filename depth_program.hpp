@@ -0,0 +1,15 @@
+#include "GL.hpp"
+#include "Load.hpp"
+
+//DepthProgram only writes depth; used by Scene's depth prepass (see Scene::depth_prepass):
+struct DepthProgram {
+	//opengl program object:
+	GLuint program = 0;
+
+	//uniform block index (streamed by Scene, see Scene::ObjectMatrices):
+	GLuint object_matrices_block = -1U;
+
+	DepthProgram();
+};
+
+extern Load< DepthProgram > depth_program;
@@ -3,15 +3,14 @@
 #include "GL.hpp"
 #include "Load.hpp"
 #include "MeshBuffer.hpp"
+#include "MeshResidency.hpp"
 #include "data_path.hpp"
 #include "compile_program.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
 //------------ resources ------------
-Load< MeshBuffer > text_meshes(LoadTagInit, [](){
-	return new MeshBuffer(data_path("menu.p"));
-});
+Load< MeshBuffer > text_meshes(LoadTagInit, "menu.p");
 
 //font metrics for "text_meshes":
 const constexpr float char_height = 3.0f;
@@ -54,9 +53,18 @@ Load< GLuint > text_program(LoadTagInit, [](){
 	return ret;
 });
 
+Load< std::vector< MeshBuffer::ID > > text_glyphs(LoadTagInit, [](){
+	std::vector< MeshBuffer::ID > *glyphs = new std::vector< MeshBuffer::ID >(256);
+	for (uint32_t c = 0; c < glyphs->size(); ++c) {
+		(*glyphs)[c] = text_meshes->find_id(std::string(1, char(c)));
+	}
+	return glyphs;
+});
+
 //Binding for using text_program on text_meshes:
-Load< GLuint > text_meshes_for_text_program(LoadTagDefault, [](){
-	return new GLuint(text_meshes->make_vao_for_program(*text_program));
+// (LoadTagInit so that text can be drawn on the loading screen)
+Load< GLuint > text_meshes_for_text_program(LoadTagInit, [](){
+	return new GLuint(text_meshes->vao_for_program(*text_program));
 });
 
 //----------------------
@@ -77,6 +85,7 @@ void draw_text(std::string const &text, glm::vec2 const &anchor, float height, g
 }
 
 void draw_text(std::string const &text, glm::mat4 const &transform, glm::vec4 color) {
+	mesh_residency.use(*text_meshes);
 	glUseProgram(*text_program);
 	glBindVertexArray(*text_meshes_for_text_program);
 
@@ -94,8 +103,12 @@ void draw_text(std::string const &text, glm::mat4 const &transform, glm::vec4 co
 			glUniformMatrix4fv(text_program_mvp_mat4, 1, GL_FALSE, glm::value_ptr(mvp));
 			glUniform4fv(text_program_color_vec4, 1, glm::value_ptr(color));
 
-			MeshBuffer::Mesh const &mesh = text_meshes->lookup(text.substr(i,1));
-			glDrawArrays(GL_TRIANGLES, mesh.start, mesh.count);
+			MeshBuffer::ID glyph = (*text_glyphs)[uint8_t(text[i])];
+			if (!glyph) {
+				throw std::runtime_error("Drawing character '" + text.substr(i,1) + "' that has no mesh.");
+			}
+			MeshBuffer::Mesh const &mesh = text_meshes->lookup(glyph);
+			glDrawElements(GL_TRIANGLES, mesh.count, text_meshes->index_type, text_meshes->index_offset(mesh.start));
 		}
 
 		x += char_width(text[i]);
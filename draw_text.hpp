@@ -1,8 +1,18 @@
 #pragma once
 
+#include "Load.hpp"
+#include "MeshBuffer.hpp"
+
 #include <glm/glm.hpp>
 
 #include <string>
+#include <vector>
+
+//The font meshes ("menu.p") used by draw_text; also used directly by MenuMode:
+extern Load< MeshBuffer > text_meshes;
+
+//IDs of character meshes in text_meshes, indexed by character (so drawing doesn't search for names):
+extern Load< std::vector< MeshBuffer::ID > > text_glyphs;
 
 //Helper functions to draw text:
 //This version draws relative to a [-aspect,aspect]x[-1,1] screen.
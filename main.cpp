@@ -10,6 +10,15 @@
 //The 'Sound' header has functions for managing sound:
 #include "Sound.hpp"
 
+//draw_text is used for the loading screen:
+#include "draw_text.hpp"
+
+//Frames are drawn offscreen at a resolution picked by 'dynamic_resolution', then upscaled:
+#include "DynamicResolution.hpp"
+
+//'mesh_residency' keeps mesh buffers' GPU memory within a budget (and is told when each frame ends):
+#include "MeshResidency.hpp"
+
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
 
@@ -28,6 +37,14 @@
 #include <fstream>
 #include <memory>
 #include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <sys/resource.h> //for getrusage (peak memory use)
+#endif
 
 int main(int argc, char **argv) {
 	struct {
@@ -36,6 +53,13 @@ int main(int argc, char **argv) {
 		glm::uvec2 size = glm::uvec2(640, 400);
 	} config;
 
+	//optional command line: --mesh-budget <kilobytes> limits GPU memory used by meshes (see MeshResidency.hpp):
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (std::string(argv[i]) == "--mesh-budget") {
+			mesh_residency.budget = size_t(std::stoul(argv[i+1])) * 1024;
+		}
+	}
+
 	//------------  initialization ------------
 
 	//Initialize SDL library:
@@ -101,11 +125,57 @@ int main(int argc, char **argv) {
 
 	//------------ load assets --------------
 
-	call_load_functions();
+	//file reading and parsing run on worker threads, while this loop runs the OpenGL parts of loading
+	// (a few milliseconds' worth per frame) and shows progress once the text drawing assets (LoadTagInit) are ready:
+	auto load_before = std::chrono::high_resolution_clock::now();
+	start_load_functions();
+	bool quit_while_loading = false;
+	while (true) {
+		SDL_Event evt;
+		while (SDL_PollEvent(&evt) == 1) {
+			if (evt.type == SDL_QUIT) quit_while_loading = true;
+		}
+		if (quit_while_loading) break;
+
+		float progress = update_load_functions(0.008f);
+		if (progress >= 1.0f) break;
+
+		int w,h;
+		SDL_GL_GetDrawableSize(window, &w, &h);
+		glViewport(0, 0, w, h);
+		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		if (load_functions_finished(LoadTagInit)) {
+			std::string message = "LOADING " + std::to_string(int(progress * 100.0f)) + " / 100";
+			float height = 0.1f;
+			draw_text(message, glm::vec2(-0.5f * text_width(message, height), -0.5f * height), height);
+		}
+		SDL_GL_SwapWindow(window);
+	}
+	auto load_after = std::chrono::high_resolution_clock::now();
+
+	if (!quit_while_loading) {
+		std::cout << "Loaded assets in " << std::chrono::duration< double, std::milli >(load_after - load_before).count() << " ms:\n";
+		asset_registry.report(std::cout);
+		#if !defined(_WIN32)
+		{ //peak memory use so far (mesh files are mapped, not read, so their pages don't need to stay resident):
+			struct rusage usage;
+			if (getrusage(RUSAGE_SELF, &usage) == 0) {
+				#if defined(__APPLE__)
+				std::cout << "Peak resident set size: " << usage.ru_maxrss / 1024 << " kB" << std::endl; //(bytes on macOS)
+				#else
+				std::cout << "Peak resident set size: " << usage.ru_maxrss << " kB" << std::endl;
+				#endif
+			}
+		}
+		#endif
+	}
 
 	//------------ create game mode + make current --------------
 
-	Mode::set_current(std::make_shared< JanitorMode >());
+	if (!quit_while_loading) {
+		Mode::set_current(std::make_shared< JanitorMode >());
+	}
 
 	//------------ main loop ------------
 
@@ -125,6 +195,43 @@ int main(int argc, char **argv) {
 	};
 	on_resize();
 
+	//update (and render snapshot extraction) runs on this worker thread, so that it can overlap with
+	//drawing the previous frame's snapshot on the main thread (which owns the OpenGL context):
+	// (events are handled on the main thread while the worker is idle, so modes never see concurrent calls)
+	std::mutex update_mutex;
+	std::condition_variable update_cv;
+	std::function< void() > update_job;
+	bool update_pending = false;
+	bool update_quit = false;
+	std::thread update_thread([&](){
+		std::unique_lock< std::mutex > lock(update_mutex);
+		while (true) {
+			update_cv.wait(lock, [&](){ return update_pending || update_quit; });
+			if (update_quit) break;
+			lock.unlock();
+			update_job();
+			lock.lock();
+			update_pending = false;
+			update_cv.notify_all();
+		}
+	});
+
+	//snapshot extracted by the previous frame's update; drawn while the current frame's update runs:
+	Mode::RenderFunction snapshot;
+
+	//frames are drawn into dynamic_resolution's offscreen target, at a size based on recent frame times:
+	auto draw_frame = [&](std::function< void(glm::uvec2 const &) > const &draw){
+		glm::uvec2 render_size = dynamic_resolution.begin(drawable_size); //(also clears)
+		//set some default state:
+		glEnable(GL_DEPTH_TEST);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+		draw(render_size);
+
+		dynamic_resolution.end(drawable_size);
+	};
+
 	//This will loop until the current mode is set to null:
 	while (Mode::current) {
 		//every pass through the game loop creates one frame of output
@@ -148,34 +255,72 @@ int main(int argc, char **argv) {
 			if (!Mode::current) break;
 		}
 
-		{ //(2) call the current mode's "update" function to deal with elapsed time:
+		Mode::RenderFunction next_snapshot;
+
+		{ //(2) start the current mode's "update" function to deal with elapsed time:
 			auto current_time = std::chrono::high_resolution_clock::now();
 			static auto previous_time = current_time;
 			float elapsed = std::chrono::duration< float >(current_time - previous_time).count();
 			previous_time = current_time;
 
+			//whole-loop time (including waiting for the previous frame to be shown) steers resolution:
+			dynamic_resolution.report_frame_time(elapsed);
+
 			//if frames are taking a very long time to process,
 			//lag to avoid spiral of death:
 			elapsed = std::min(0.1f, elapsed);
 
-			Mode::current->update(elapsed);
-			if (!Mode::current) break;
+			std::unique_lock< std::mutex > lock(update_mutex);
+			update_job = [elapsed,&next_snapshot](){
+				Mode::current->update(elapsed);
+				if (Mode::current) next_snapshot = Mode::current->extract();
+			};
+			update_pending = true;
+			update_cv.notify_all();
 		}
 
-		{ //(3) call the current mode's "draw" function to produce output:
-			//clear the depth+color buffers and set some default state:
-			glClearColor(0.5, 0.5, 0.5, 0.0);
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-			glEnable(GL_DEPTH_TEST);
-			glEnable(GL_BLEND);
-			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		{ //(3) draw the previous frame's snapshot while update runs, then wait for update to finish:
+			if (snapshot) {
+				draw_frame(snapshot);
+			}
 
-			Mode::current->draw(drawable_size);
+			std::unique_lock< std::mutex > lock(update_mutex);
+			update_cv.wait(lock, [&](){ return !update_pending; });
 		}
+		if (!Mode::current) break;
+
+		//nothing was drawn alongside update (first frame, or a mode without snapshots), so draw in sequence:
+		if (!snapshot) {
+			if (next_snapshot) {
+				draw_frame(next_snapshot);
+			} else {
+				std::shared_ptr< Mode > mode = Mode::current;
+				draw_frame([&mode](glm::uvec2 const &size){ mode->draw(size); });
+			}
+		}
+		snapshot = next_snapshot;
+
+		//finish loads added during play (e.g. streamed level assets) a few milliseconds' worth at a time:
+		// (the update thread is idle here, so modes never see a Load<> change while they use it)
+		update_load_functions(0.002f);
+
+		//mesh buffers not drawn this frame may be evicted to stay within budget:
+		mesh_residency.end_frame();
 
 		//Finally, wait until the recently-drawn frame is shown before doing it all again:
 		SDL_GL_SwapWindow(window);
 	}
+	mesh_residency.report(std::cout);
+
+	{ //stop the update thread:
+		std::unique_lock< std::mutex > lock(update_mutex);
+		update_quit = true;
+		update_cv.notify_all();
+	}
+	update_thread.join();
+	snapshot = nullptr;
+
+	dynamic_resolution.release();
 
 
 	//------------  teardown ------------
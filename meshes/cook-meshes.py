@@ -0,0 +1,159 @@
+#!/usr/bin/env python
+
+#Note: Script meant to be executed (outside of blender) on the output of export-meshes.py, as per:
+#python cook-meshes.py [--compress] <infile.pnc> <outfile.qpnc>
+
+#Cooks a '.pnc' mesh blob into the compact '.qpnc' layout read by MeshBuffer:
+# Position: three 16-bit normalized integers (plus one padding short), relative to the bounds of each mesh
+# Normal: GL_INT_2_10_10_10_REV (10-bit signed normalized xyz)
+# Color: unchanged (4 x 8-bit normalized)
+#That's 16 bytes per vertex instead of 28. Each mesh's position scale and bias (position = scale * stored + bias)
+# are written to a 'qsb0' chunk that parallels the index chunk.
+#With --compress, the vertices are written to a 'qpnz' chunk instead of a 'qpnc' chunk:
+# a uint32 vertex count followed by the vertices compressed as described in VertexCodec.hpp
+# (byte-wise deltas between consecutive vertices, packed in groups of 16 at 0, 2, 4, or 8 bits per delta).
+
+import sys
+import struct
+import math
+
+args = sys.argv[1:]
+compress = False
+if len(args) > 0 and args[0] == '--compress':
+	compress = True
+	args = args[1:]
+if len(args) != 2 or not args[0].endswith('.pnc') or not args[1].endswith('.qpnc'):
+	print("\n\nUsage:\npython cook-meshes.py [--compress] <infile.pnc> <outfile.qpnc>\nQuantizes the vertices of a mesh blob written by export-meshes.py.\n")
+	exit(1)
+
+infile = args[0]
+outfile = args[1]
+
+def read_chunk(blob, magic):
+	header = blob.read(8)
+	assert(len(header) == 8)
+	(got, size) = struct.unpack('4sI', header)
+	assert(got == magic)
+	data = blob.read(size)
+	assert(len(data) == size)
+	return data
+
+blob = open(infile, 'rb')
+data = read_chunk(blob, b'pnc.')
+strings = read_chunk(blob, b'str0')
+index = read_chunk(blob, b'idx0')
+blob.close()
+
+VertexBytes = 3*4 + 3*4 + 4
+assert(len(data) % VertexBytes == 0)
+vertices = [ struct.unpack_from('3f3f4B', data, i) for i in range(0, len(data), VertexBytes) ]
+
+entries = [ struct.unpack_from('4I', index, i) for i in range(0, len(index), 16) ]
+
+#meshes whose vertex ranges overlap must share bounds (a vertex is stored only once), so group them:
+groups = [] #[begin, end, [entries]]
+for e in sorted(range(0, len(entries)), key=lambda e: entries[e][2]):
+	(name_begin, name_end, vertex_begin, vertex_end) = entries[e]
+	if len(groups) > 0 and vertex_begin < groups[-1][1]:
+		groups[-1][1] = max(groups[-1][1], vertex_end)
+		groups[-1][2].append(e)
+	else:
+		groups.append([vertex_begin, vertex_end, [e]])
+
+scale_bias = [ None ] * len(entries)
+stored = [ None ] * len(vertices)
+for (begin, end, members) in groups:
+	if begin == end:
+		for e in members: scale_bias[e] = (1.0, 1.0, 1.0, 0.0, 0.0, 0.0)
+		continue
+	lo = [ min(vertices[i][c] for i in range(begin, end)) for c in range(0,3) ]
+	hi = [ max(vertices[i][c] for i in range(begin, end)) for c in range(0,3) ]
+	bias = [ 0.5 * (lo[c] + hi[c]) for c in range(0,3) ]
+	scale = [ max(0.5 * (hi[c] - lo[c]), 1e-20) for c in range(0,3) ]
+	for e in members: scale_bias[e] = tuple(scale + bias)
+	for i in range(begin, end):
+		stored[i] = tuple(
+			max(-32767, min(32767, int(round((vertices[i][c] - bias[c]) / scale[c] * 32767.0))))
+			for c in range(0,3)
+		)
+
+def pack_normal(n):
+	length = math.sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2])
+	if length > 0.0: n = [ x / length for x in n ]
+	bits = 0
+	for c in range(0,3):
+		v = max(-511, min(511, int(round(n[c] * 511.0))))
+		bits |= (v & 0x3ff) << (10 * c)
+	return bits
+
+cooked = b""
+for i in range(0, len(vertices)):
+	v = vertices[i]
+	s = stored[i] if stored[i] != None else (0, 0, 0) #(vertices not in any mesh)
+	cooked += struct.pack('4h', s[0], s[1], s[2], 0)
+	cooked += struct.pack('I', pack_normal(v[3:6]))
+	cooked += struct.pack('4B', *v[6:10])
+
+#must match VertexCodec.hpp:
+BlockVertices = 256
+
+def encode_group(group):
+	#pick the smallest packing (see VertexCodec.hpp):
+	best = (0, b"") if max(group) == 0 else (3, bytes(group))
+	for (mode, bits) in [ (1, 2), (2, 4) ]:
+		escape = (1 << bits) - 1
+		packed = bytearray(16 * bits // 8)
+		literals = bytearray()
+		for j in range(0, 16):
+			v = group[j]
+			if v >= escape:
+				literals.append(v)
+				v = escape
+			packed[(j * bits) // 8] |= v << ((j * bits) % 8)
+		if len(packed) + len(literals) < len(best[1]):
+			best = (mode, bytes(packed + literals))
+	return best
+
+def encode_vertices(data, stride):
+	count = len(data) // stride
+	out = bytearray()
+	previous = bytes(stride)
+	for block in range(0, count, BlockVertices):
+		vertices = min(BlockVertices, count - block)
+		groups = (vertices + 15) // 16
+		for k in range(0, stride):
+			deltas = []
+			value = previous[k]
+			for i in range(block, block + vertices):
+				d = (data[i * stride + k] - value) & 0xff
+				deltas.append(((d << 1) & 0xff) ^ (0xff if d & 0x80 else 0x00)) #zigzag
+				value = data[i * stride + k]
+			deltas += [0] * (16 * groups - vertices)
+			modes = bytearray((groups + 3) // 4)
+			packed = bytearray()
+			for g in range(0, groups):
+				(mode, bits) = encode_group(deltas[16*g:16*g+16])
+				modes[g // 4] |= mode << (2 * (g % 4))
+				packed += bits
+			out += modes + packed
+		previous = data[(block + vertices - 1) * stride : (block + vertices) * stride]
+	return bytes(out)
+
+vertex_magic = b'qpnc'
+if compress:
+	vertex_magic = b'qpnz'
+	cooked = struct.pack('I', len(vertices)) + encode_vertices(cooked, 16)
+
+qsb = b""
+for sb in scale_bias:
+	qsb += struct.pack('6f', *sb)
+
+blob = open(outfile, 'wb')
+for (magic, chunk) in [ (vertex_magic, cooked), (b'str0', strings), (b'idx0', index), (b'qsb0', qsb) ]:
+	blob.write(struct.pack('4s', magic)) #type
+	blob.write(struct.pack('I', len(chunk))) #length
+	blob.write(chunk)
+wrote = blob.tell()
+blob.close()
+
+print("Wrote " + str(wrote) + " bytes [== " + str(len(cooked)+8) + " bytes of data (was " + str(len(data)+8) + ") + " + str(len(strings)+8) + " bytes of strings + " + str(len(index)+8) + " bytes of index + " + str(len(qsb)+8) + " bytes of scale/bias] to '" + outfile + "'")
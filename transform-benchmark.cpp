@@ -0,0 +1,419 @@
+//transform-benchmark measures building and updating large transform hierarchies:
+// - it loads the exported 'crates.scene' through Scene::load several times into one scene
+//   (Scene::load reports its own time per thousand transforms);
+// - it builds a large hierarchy (many roots, each with a tree of descendants), then times updates that
+//   move every root (so every transform is recomputed) with ThreadPools of 1 to N threads;
+// - on the same hierarchy, it times updates where nothing, 1% of the roots, or every root moved
+//   (unchanged transforms are skipped), and the per-item matrix work of Scene::draw_items with the
+//   cached normal matrix against recomputing it from the world matrix;
+// - it gathers draw lists for a field of objects with and without level-of-detail chains
+//   (the chains come from a generated sphere mesh file, through MeshBuffer::lookup_lods);
+// - it moves 100k objects around the proximity grid, timing the grid's share of update_transforms,
+//   then times query_radius against a scan of every object;
+// - it times the per-character glyph lookup done when drawing text from 'menu.p': a character -> ID table
+//   (as draw_text.cpp uses) against looking each character up by name.
+//
+//Usage:
+//  dist/transform-benchmark [roots] [transforms per root]
+
+#include "Scene.hpp"
+#include "ThreadPool.hpp"
+#include "MeshBuffer.hpp"
+#include "data_path.hpp"
+
+//(the benchmark links with the game's libraries, so it includes SDL.h for SDL_main on Windows)
+#include <SDL.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+//write a '.p' mesh file with a sphere ("Sphere") and two coarser versions ("Sphere.LOD1", "Sphere.LOD2"):
+static void write_sphere_lods(std::string const &filename) {
+	std::vector< glm::vec3 > soup;
+	std::string strings;
+	struct IndexEntry {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end;
+	};
+	std::vector< IndexEntry > index;
+	const char *names[3] = {"Sphere", "Sphere.LOD1", "Sphere.LOD2"};
+	for (uint32_t level = 0; level < 3; ++level) {
+		uint32_t slices = 48 >> level;
+		uint32_t stacks = 24 >> level;
+		auto point = [&](uint32_t slice, uint32_t stack) {
+			float theta = float(slice) / float(slices) * 2.0f * 3.14159265f;
+			float phi = float(stack) / float(stacks) * 3.14159265f;
+			return glm::vec3(std::cos(theta) * std::sin(phi), std::sin(theta) * std::sin(phi), std::cos(phi));
+		};
+		IndexEntry entry;
+		entry.name_begin = uint32_t(strings.size());
+		strings += names[level];
+		entry.name_end = uint32_t(strings.size());
+		entry.vertex_begin = uint32_t(soup.size());
+		for (uint32_t stack = 0; stack < stacks; ++stack) {
+			for (uint32_t slice = 0; slice < slices; ++slice) {
+				glm::vec3 a = point(slice, stack), b = point(slice + 1, stack);
+				glm::vec3 c = point(slice, stack + 1), d = point(slice + 1, stack + 1);
+				if (stack > 0) {
+					soup.emplace_back(a); soup.emplace_back(c); soup.emplace_back(b);
+				}
+				if (stack + 1 < stacks) {
+					soup.emplace_back(b); soup.emplace_back(c); soup.emplace_back(d);
+				}
+			}
+		}
+		entry.vertex_end = uint32_t(soup.size());
+		index.emplace_back(entry);
+	}
+
+	std::ofstream out(filename, std::ios::binary);
+	auto write_chunk = [&out](char const *magic, void const *data, size_t size) {
+		uint32_t size32 = uint32_t(size);
+		out.write(magic, 4);
+		out.write(reinterpret_cast< char const * >(&size32), 4);
+		out.write(reinterpret_cast< char const * >(data), size);
+	};
+	write_chunk("p...", soup.data(), soup.size() * sizeof(glm::vec3));
+	write_chunk("str0", strings.data(), strings.size());
+	write_chunk("idx0", index.data(), index.size() * sizeof(IndexEntry));
+	if (!out) throw std::runtime_error("Failed to write '" + filename + "'.");
+}
+
+//time serial updates of a hierarchy where nothing, some roots, or every root moved:
+static void benchmark_static_updates(Scene &scene, std::vector< Scene::Transform * > const &roots, uint32_t iterations) {
+	std::cout << "Updating the same transforms serially when only some move, " << iterations << " times:" << std::endl;
+	scene.update_transforms();
+	for (uint32_t stride : {0U, 100U, 1U}) {
+		double total = 0.0;
+		uint32_t recomputed = 0;
+		for (uint32_t iteration = 0; iteration < iterations; ++iteration) {
+			if (stride != 0) {
+				for (uint32_t r = 0; r < roots.size(); r += stride) roots[r]->position.x += 0.01f;
+			}
+			auto before = std::chrono::high_resolution_clock::now();
+			scene.update_transforms();
+			auto after = std::chrono::high_resolution_clock::now();
+			total += std::chrono::duration< double, std::milli >(after - before).count();
+			recomputed += scene.update_stats.recomputed;
+		}
+		std::cout << "  " << (stride == 0 ? "nothing moved:  " : (stride == 1 ? "all roots moved:" : "1% roots moved: "))
+			<< " " << total / iterations << " ms per update (" << recomputed / iterations << " of "
+			<< scene.update_stats.transforms << " recomputed)" << std::endl;
+	}
+}
+
+//time the per-item matrix work done by Scene::draw_items, with the cached normal matrix and with it recomputed:
+static void benchmark_item_matrices(Scene const &scene, uint32_t iterations) {
+	std::vector< Scene::DrawItem > items;
+	items.reserve(scene.transforms.size());
+	for (auto transform : scene.transforms) {
+		items.emplace_back();
+		items.back().local_to_world = transform->local_to_world;
+		items.back().normal_to_world = transform->normal_to_world;
+	}
+	glm::mat4 world_to_clip = glm::infinitePerspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f);
+	std::vector< Scene::ObjectMatrices > staging(items.size());
+
+	std::cout << "Computing matrices for " << items.size() << " draw items, " << iterations << " times:" << std::endl;
+	float max_difference = 0.0f; //between cached and recomputed normal matrices
+	for (bool cached : {true, false}) {
+		double total = 0.0;
+		for (uint32_t iteration = 0; iteration < iterations; ++iteration) {
+			auto before = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < items.size(); ++i) {
+				//(as in Scene::draw_items)
+				glm::mat4 const &mv = items[i].local_to_world;
+				glm::mat3 itmv = (cached ? items[i].normal_to_world : glm::inverse(glm::transpose(glm::mat3(mv))));
+				Scene::ObjectMatrices &om = staging[i];
+				om.object_to_clip = world_to_clip * mv;
+				for (uint32_t c = 0; c < 4; ++c) om.object_to_light[c] = glm::vec4(glm::vec3(mv[c]), 0.0f);
+				for (uint32_t c = 0; c < 3; ++c) om.normal_to_light[c] = glm::vec4(itmv[c], 0.0f);
+			}
+			auto after = std::chrono::high_resolution_clock::now();
+			total += std::chrono::duration< double, std::milli >(after - before).count();
+		}
+		if (!cached) {
+			for (uint32_t i = 0; i < items.size(); ++i) {
+				for (uint32_t c = 0; c < 3; ++c) {
+					glm::vec3 difference = glm::vec3(staging[i].normal_to_light[c]) - items[i].normal_to_world[c];
+					max_difference = std::max(max_difference, std::max(std::abs(difference.x), std::max(std::abs(difference.y), std::abs(difference.z))));
+				}
+			}
+		}
+		std::cout << "  " << (cached ? "cached normal matrix:     " : "recomputed normal matrix: ") << total / iterations << " ms per frame ("
+			<< total / iterations / items.size() * 1.0e6 << " ns per item)" << std::endl;
+	}
+	std::cout << "  (largest difference between cached and recomputed normal matrices: " << max_difference << ")" << std::endl;
+}
+
+//gather the draw list of a camera looking over a field of spheres, with and without LOD chains:
+static void benchmark_lod(uint32_t iterations) {
+	std::string filename = data_path("lod-benchmark.p");
+	write_sphere_lods(filename);
+	MeshBuffer buffer(filename);
+	std::remove(filename.c_str());
+	std::vector< MeshBuffer::Mesh > lods = buffer.lookup_lods("Sphere");
+
+	Scene scene;
+	Scene::Material *material = scene.new_material();
+	Scene::Camera *camera = scene.new_camera(scene.new_transform());
+	camera->transform->rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f); //(looking down -z)
+	camera->transform->position = glm::vec3(0.0f, 2.0f, 0.0f);
+
+	//100 x 100 spheres, from just in front of the camera to 400 units away:
+	for (uint32_t row = 0; row < 100; ++row) {
+		for (uint32_t column = 0; column < 100; ++column) {
+			Scene::Transform *transform = scene.new_transform();
+			transform->position = glm::vec3(2.0f * float(column) - 100.0f, 0.0f, -4.0f * float(row + 1));
+			Scene::Object *object = scene.new_object(transform);
+			object->material = material;
+			object->index_type = buffer.index_type;
+			object->start = lods[0].start;
+			object->count = lods[0].count;
+			object->lod_center = lods[0].center;
+			object->lod_radius = lods[0].radius;
+		}
+	}
+	scene.update_transforms();
+
+	std::cout << "Gathering " << scene.objects.size() << " spheres (" << lods[0].count / 3 << " triangles at full detail, "
+		<< lods.size() - 1 << " coarser levels), " << iterations << " times:" << std::endl;
+	for (bool use_lods : {false, true}) {
+		for (auto object : scene.objects) {
+			object->lods.clear();
+			object->lod = 0;
+			if (!use_lods) continue;
+			for (auto const &mesh : lods) {
+				object->lods.emplace_back();
+				object->lods.back().start = mesh.start;
+				object->lods.back().count = mesh.count;
+			}
+		}
+
+		std::vector< Scene::View > views(1);
+		views[0].camera = camera;
+		views[0].aspect = 16.0f / 9.0f;
+		double total = 0.0;
+		for (uint32_t iteration = 0; iteration < iterations; ++iteration) {
+			auto before = std::chrono::high_resolution_clock::now();
+			scene.gather_views(&views);
+			auto after = std::chrono::high_resolution_clock::now();
+			total += std::chrono::duration< double, std::milli >(after - before).count();
+		}
+
+		uint64_t triangles = 0;
+		std::vector< uint32_t > per_level(lods.size(), 0); //(levels are told apart by their index ranges)
+		for (auto const &item : views[0].items) {
+			triangles += item.count / 3;
+			for (uint32_t level = 0; level < lods.size(); ++level) {
+				if (item.start == lods[level].start) per_level[level] += 1;
+			}
+		}
+		std::cout << "  " << (use_lods ? "with LODs:    " : "without LODs: ") << views[0].items.size() << " items, "
+			<< triangles << " triangles, " << total / iterations << " ms per gather";
+		if (use_lods) {
+			std::cout << " (items per level:";
+			for (auto count : per_level) std::cout << " " << count;
+			std::cout << ")";
+		}
+		std::cout << std::endl;
+	}
+}
+
+//move many objects through the proximity grid, then compare query_radius with a brute-force scan:
+static void benchmark_grid(uint32_t iterations) {
+	const uint32_t Objects = 100000;
+	const uint32_t Queries = 1000;
+	const float QueryRadius = 5.0f;
+
+	//two scenes with the same transforms, one with objects attached (so the difference in update time is the grid's):
+	Scene with_objects, without_objects;
+	std::vector< Scene::Transform * > moving[2];
+	std::vector< glm::vec3 > velocities;
+	std::mt19937 mt(0x31415926);
+	auto random = [&mt](float lo, float hi) { return std::uniform_real_distribution< float >(lo, hi)(mt); };
+	for (uint32_t i = 0; i < Objects; ++i) {
+		glm::vec3 position = glm::vec3(random(-200.0f, 200.0f), random(-200.0f, 200.0f), random(0.0f, 10.0f));
+		velocities.emplace_back(random(-0.1f, 0.1f), random(-0.1f, 0.1f), 0.0f);
+		for (uint32_t s = 0; s < 2; ++s) {
+			Scene &scene = (s == 0 ? with_objects : without_objects);
+			Scene::Transform *transform = scene.new_transform();
+			transform->position = position;
+			moving[s].emplace_back(transform);
+			if (s == 0) scene.new_object(transform);
+		}
+	}
+	with_objects.update_transforms();
+	without_objects.update_transforms();
+
+	std::cout << "Moving " << Objects << " objects through the grid (cell size " << with_objects.grid.cell_size << "), "
+		<< iterations << " times:" << std::endl;
+	//everything moves, then only one object in a hundred moves:
+	for (uint32_t stride : {1U, 100U}) {
+		double total[2] = {0.0, 0.0};
+		for (uint32_t iteration = 0; iteration < iterations; ++iteration) {
+			for (uint32_t s = 0; s < 2; ++s) {
+				for (uint32_t i = 0; i < Objects; i += stride) moving[s][i]->position += velocities[i];
+				Scene &scene = (s == 0 ? with_objects : without_objects);
+				auto before = std::chrono::high_resolution_clock::now();
+				scene.update_transforms();
+				auto after = std::chrono::high_resolution_clock::now();
+				total[s] += std::chrono::duration< double, std::milli >(after - before).count();
+			}
+		}
+		std::cout << "  " << (stride == 1 ? "all moving:     " : "1% moving:      ") << total[0] / iterations << " ms per update_transforms with the grid, "
+			<< total[1] / iterations << " ms without (grid: " << (total[0] - total[1]) / iterations << " ms)" << std::endl;
+	}
+
+	std::vector< glm::vec3 > centers;
+	for (uint32_t q = 0; q < Queries; ++q) {
+		centers.emplace_back(random(-200.0f, 200.0f), random(-200.0f, 200.0f), random(0.0f, 10.0f));
+	}
+	std::vector< Scene::Object * > found;
+	uint64_t grid_found = 0, scan_found = 0;
+	auto before = std::chrono::high_resolution_clock::now();
+	for (auto const &center : centers) {
+		found.clear();
+		with_objects.query_radius(center, QueryRadius, &found);
+		grid_found += found.size();
+	}
+	auto middle = std::chrono::high_resolution_clock::now();
+	for (auto const &center : centers) {
+		found.clear();
+		for (auto object : with_objects.objects) {
+			glm::vec3 to = glm::vec3(object->transform->local_to_world[3]) - center;
+			if (glm::dot(to, to) <= QueryRadius * QueryRadius) found.emplace_back(object);
+		}
+		scan_found += found.size();
+	}
+	auto after = std::chrono::high_resolution_clock::now();
+	double grid_us = std::chrono::duration< double, std::micro >(middle - before).count() / Queries;
+	double scan_us = std::chrono::duration< double, std::micro >(after - middle).count() / Queries;
+	std::cout << "  query_radius(" << QueryRadius << "): " << grid_us << " us per query; scanning every object: "
+		<< scan_us << " us (" << scan_us / grid_us << "x)" << std::endl;
+	if (grid_found != scan_found) {
+		std::cerr << "ERROR: grid queries found " << grid_found << " objects, but scans found " << scan_found << "." << std::endl;
+	}
+}
+
+//look up the meshes for the characters of some HUD-like text, by table and by name:
+static void benchmark_glyphs(uint32_t iterations) {
+	MeshBuffer font(data_path("menu.p"));
+	std::vector< MeshBuffer::ID > glyphs(256); //(built as draw_text.cpp builds text_glyphs)
+	for (uint32_t c = 0; c < glyphs.size(); ++c) {
+		glyphs[c] = font.find_id(std::string(1, char(c)));
+	}
+
+	std::string text;
+	for (uint32_t i = 0; i < 1000; ++i) {
+		text += "USE WASD TO MOVE SCORE " + std::to_string(i) + " YOUR MOP IS DIRTY! ";
+	}
+
+	std::cout << "Looking up " << text.size() << " characters of text, " << iterations << " times:" << std::endl;
+	//(spaces are skipped, as draw_text does; totals of the meshes' counts keep the lookups from being optimized away)
+	uint64_t counts[2] = {0, 0};
+	double total[2] = {0.0, 0.0};
+	for (uint32_t iteration = 0; iteration < iterations; ++iteration) {
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < text.size(); ++i) {
+			if (text[i] != ' ') counts[0] += font.lookup(glyphs[uint8_t(text[i])]).count;
+		}
+		auto middle = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < text.size(); ++i) {
+			if (text[i] != ' ') counts[1] += font.lookup(text.substr(i,1)).count;
+		}
+		auto after = std::chrono::high_resolution_clock::now();
+		total[0] += std::chrono::duration< double, std::nano >(middle - before).count();
+		total[1] += std::chrono::duration< double, std::nano >(after - middle).count();
+	}
+	double per_char[2] = { total[0] / iterations / text.size(), total[1] / iterations / text.size() };
+	std::cout << "  glyph table:    " << per_char[0] << " ns per character" << std::endl;
+	std::cout << "  lookup by name: " << per_char[1] << " ns per character (" << per_char[1] / per_char[0] << "x)" << std::endl;
+	if (counts[0] != counts[1]) {
+		std::cerr << "ERROR: glyph table and name lookups found different meshes." << std::endl;
+	}
+}
+
+int main(int argc, char **argv) {
+	uint32_t roots = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 1000);
+	uint32_t per_root = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 200);
+	uint32_t max_threads = std::max(1U, std::thread::hardware_concurrency());
+	const uint32_t Iterations = 20;
+	const uint32_t SceneCopies = 10;
+
+	{ //load an exported scene (one object per mesh reference, as a level would):
+		Scene loaded;
+		for (uint32_t copy = 0; copy < SceneCopies; ++copy) {
+			loaded.load(data_path("crates.scene"), [](Scene &scene, Scene::Transform *transform, std::string const &) {
+				scene.new_object(transform);
+			});
+		}
+		loaded.update_transforms();
+		std::cout << "Loaded 'crates.scene' " << SceneCopies << " times: " << loaded.transforms.size() << " transforms, "
+			<< loaded.objects.size() << " objects, " << loaded.cameras.size() << " cameras." << std::endl;
+	}
+
+	Scene scene;
+	std::vector< Scene::Transform * > root_transforms;
+	for (uint32_t r = 0; r < roots; ++r) {
+		Scene::Transform *root = scene.new_transform();
+		root->position = glm::vec3(float(r % 100), float(r / 100), 0.0f);
+		root_transforms.emplace_back(root);
+		//each transform's parent is one of the earlier transforms in its tree (a bushy tree a few levels deep):
+		std::vector< Scene::Transform * > tree(1, root);
+		for (uint32_t i = 1; i < per_root; ++i) {
+			Scene::Transform *transform = scene.new_transform();
+			transform->set_parent(tree[(i - 1) / 4]);
+			transform->position = glm::vec3(0.1f * float(i % 7), 0.2f, 0.1f * float(i % 3));
+			transform->scale = glm::vec3(0.99f);
+			tree.emplace_back(transform);
+		}
+	}
+	std::cout << "Updating " << scene.transforms.size() << " transforms (" << roots << " roots of "
+		<< per_root << "), " << Iterations << " times per pool size:" << std::endl;
+
+	//pool sizes to measure: powers of two below max_threads, then max_threads itself:
+	std::vector< uint32_t > thread_counts;
+	for (uint32_t threads = 1; threads < max_threads; threads *= 2) thread_counts.emplace_back(threads);
+	thread_counts.emplace_back(max_threads);
+
+	double serial_ms = 0.0;
+	for (uint32_t threads : thread_counts) {
+		ThreadPool pool(threads);
+		scene.update_transforms(&pool); //(warm up)
+		double total = 0.0;
+		for (uint32_t iteration = 0; iteration < Iterations; ++iteration) {
+			for (auto root : root_transforms) root->position.z = float(iteration + 1); //(moves every transform)
+			auto before = std::chrono::high_resolution_clock::now();
+			scene.update_transforms(&pool);
+			auto after = std::chrono::high_resolution_clock::now();
+			total += std::chrono::duration< double, std::milli >(after - before).count();
+			if (scene.update_stats.recomputed != scene.update_stats.transforms) {
+				std::cerr << "ERROR: only " << scene.update_stats.recomputed << " of " << scene.update_stats.transforms << " transforms were recomputed." << std::endl;
+				return 1;
+			}
+		}
+		double ms = total / Iterations;
+		if (threads == 1) serial_ms = ms;
+		std::cout << "  " << threads << " thread(s): " << ms << " ms per update (" << serial_ms / ms << "x)" << std::endl;
+	}
+
+	benchmark_static_updates(scene, root_transforms, Iterations);
+	benchmark_item_matrices(scene, Iterations);
+	benchmark_lod(Iterations);
+	benchmark_grid(Iterations);
+	benchmark_glyphs(Iterations);
+
+	return 0;
+}
@@ -1,16 +1,20 @@
 #include "vertex_color_program.hpp"
 
 #include "compile_program.hpp"
+#include "Scene.hpp"
 
 VertexColorProgram::VertexColorProgram() {
 	program = compile_program(
 		"#version 330\n"
-		"uniform mat4 object_to_clip;\n"
-		"uniform mat4x3 object_to_light;\n"
-		"uniform mat3 normal_to_light;\n"
+		"layout(std140) uniform ObjectMatrices {\n" //see Scene::ObjectMatrices
+		"	mat4 object_to_clip;\n"
+		"	mat4x3 object_to_light;\n"
+		"	mat3 normal_to_light;\n"
+		"};\n"
 		"layout(location=0) in vec4 Position;\n" //note: layout keyword used to make sure that the location-0 attribute is always bound to something
 		"in vec3 Normal;\n"
 		"in vec4 Color;\n"
+		"invariant gl_Position;\n" //so depth matches Scene's depth prepass exactly
 		"out vec3 position;\n"
 		"out vec3 normal;\n"
 		"out vec4 color;\n"
@@ -47,9 +51,8 @@ VertexColorProgram::VertexColorProgram() {
 		"}\n"
 	);
 
-	object_to_clip_mat4 = glGetUniformLocation(program, "object_to_clip");
-	object_to_light_mat4x3 = glGetUniformLocation(program, "object_to_light");
-	normal_to_light_mat3 = glGetUniformLocation(program, "normal_to_light");
+	object_matrices_block = glGetUniformBlockIndex(program, "ObjectMatrices");
+	glUniformBlockBinding(program, object_matrices_block, Scene::ObjectMatricesBinding);
 
 	sun_direction_vec3 = glGetUniformLocation(program, "sun_direction");
 	sun_color_vec3 = glGetUniformLocation(program, "sun_color");